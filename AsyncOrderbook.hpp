@@ -0,0 +1,185 @@
+#pragma once
+
+#include "Order.hpp"
+#include "OrderCommand.hpp"
+#include "OrderModify.hpp"
+#include "Sequencer.hpp"
+#include "Trade.hpp"
+#include "Usings.hpp"
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <format>
+#include <stdexcept>
+#include <utility>
+
+/**
+ * Coroutine front end to a Sequencer, for a gateway running on an event loop.
+ *
+ *   Trades trades = co_await client.AddOrder(order);
+ *
+ * submits the command to the matching thread and suspends the caller. The
+ * event loop calls Poll() whenever it likes (every tick, say), and that is
+ * where finished commands get their trades and their coroutines resume.
+ * Nothing blocks, nothing takes a lock, and one thread can have as many
+ * orders in flight as it has coroutines.
+ *
+ * The client must be the Sequencer's only producer and the only thing polling
+ * its reports. Every producer's reports come back on one ring, so anything
+ * another producer submitted would be taken here and never reach whoever
+ * sent it. A single producer's commands are applied in the order they were
+ * submitted, so reports come back in that order too, and the client matches
+ * them to requests with a plain FIFO rather than a lookup. Each report's tag
+ * is checked against the oldest request all the same. One that doesn't match
+ * means that contract was broken and no report can be trusted to be whose it
+ * looks like, so every request in flight is resumed with a std::logic_error
+ * rather than left waiting for a report that may never come.
+ *
+ * When the producer's ring is full, commands wait in the same FIFO and Poll()
+ * submits them once there's room, so co_await never fails. Before the
+ * Sequencer is stopped, keep polling until InFlight() reaches zero.
+ */
+class AsyncOrderbook {
+public:
+  // What the co_await is on. It lives in the awaiting coroutine's frame, so
+  // the client can link it into its FIFO without allocating.
+  class Request {
+  public:
+    Request(const Request &) = delete;
+    void operator=(const Request &) = delete;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> waiter) {
+      waiter_ = waiter;
+      client_->Enqueue(*this);
+    }
+    Trades await_resume() {
+      if (error_)
+        std::rethrow_exception(error_);
+      return std::move(trades_);
+    }
+
+  private:
+    friend class AsyncOrderbook;
+
+    Request(AsyncOrderbook &client, const OrderCommand &command)
+        : client_{&client}, command_{command} {}
+
+    AsyncOrderbook *client_;
+    OrderCommand command_;
+    Trades trades_;
+    std::exception_ptr error_;
+    std::coroutine_handle<> waiter_;
+    Request *next_{nullptr};
+  };
+
+  AsyncOrderbook(Sequencer &sequencer, std::size_t producer)
+      : sequencer_{sequencer}, producer_{producer} {}
+
+  AsyncOrderbook(const AsyncOrderbook &) = delete;
+  void operator=(const AsyncOrderbook &) = delete;
+
+  // Each resolves to the trades the command produced, once it has been
+  // applied
+  Request AddOrder(const Order &order) {
+    return Request{*this, OrderCommand::ForAdd(order)};
+  }
+  Request ModifyOrder(const OrderModify &order) {
+    return Request{*this, OrderCommand::ForModify(order)};
+  }
+  Request CancelOrder(OrderId orderId) {
+    return Request{*this, OrderCommand::ForCancel(orderId)};
+  }
+
+  /**
+   * Submits whatever the ring had no room for, then takes every report that
+   * has come back, resuming each request whose command has completed.
+   * Returns how many were resumed.
+   *
+   * Resumed coroutines run right here, and may co_await again; they just
+   * shouldn't call Poll() themselves. A report that isn't the oldest
+   * request's fails every request in flight (see above).
+   */
+  std::size_t Poll() {
+    while (unsent_ != nullptr &&
+           sequencer_.TrySubmit(producer_, unsent_->command_))
+      unsent_ = unsent_->next_;
+
+    std::size_t resumed{};
+    ExecutionReport report;
+    while (sequencer_.TryPoll(report)) {
+      auto *request = oldest_;
+      if (request == nullptr || report.tag_ != request->command_.tag_) {
+        resumed += FailAll(report.tag_);
+        continue;
+      }
+      if (report.type_ == ReportType::Trade) {
+        request->trades_.emplace_back(report.bidTrade_, report.askTrade_);
+        continue;
+      }
+
+      // Unlink before resuming: the coroutine may well destroy the request,
+      // or queue another
+      oldest_ = request->next_;
+      if (oldest_ == nullptr)
+        newest_ = nullptr;
+      --inFlight_;
+      request->waiter_.resume();
+      ++resumed;
+    }
+
+    return resumed;
+  }
+
+  // Submitted or waiting to be, and not yet resumed
+  std::size_t InFlight() const { return inFlight_; }
+
+private:
+  Sequencer &sequencer_;
+  std::size_t producer_;
+  // Every request in flight, oldest first. The ones from unsent_ on haven't
+  // made it into the ring yet.
+  Request *oldest_{nullptr};
+  Request *newest_{nullptr};
+  Request *unsent_{nullptr};
+  std::uint64_t nextTag_{};
+  std::size_t inFlight_{};
+
+  // Resumes everything in flight with an error. The FIFO is taken over first,
+  // so anything the coroutines co_await on the way out starts a new one.
+  std::size_t FailAll(std::uint64_t tag) {
+    const auto error = std::make_exception_ptr(std::logic_error(std::format(
+        "Report for tag {} is not the oldest request's; the client must be "
+        "its Sequencer's only producer.",
+        tag)));
+
+    auto *request = std::exchange(oldest_, nullptr);
+    newest_ = unsent_ = nullptr;
+    std::size_t failed{};
+    while (request != nullptr) {
+      auto *next = request->next_;
+      request->error_ = error;
+      --inFlight_;
+      request->waiter_.resume();
+      ++failed;
+      request = next;
+    }
+    return failed;
+  }
+
+  void Enqueue(Request &request) {
+    request.command_.tag_ = nextTag_++;
+    if (newest_ == nullptr)
+      oldest_ = &request;
+    else
+      newest_->next_ = &request;
+    newest_ = &request;
+    ++inFlight_;
+
+    // Anything already waiting goes first, to keep the order
+    if (unsent_ == nullptr &&
+        !sequencer_.TrySubmit(producer_, request.command_))
+      unsent_ = &request;
+  }
+};
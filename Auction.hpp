@@ -0,0 +1,99 @@
+#pragma once
+
+#include "LevelInfos.hpp"
+#include "LevelKernels.hpp"
+#include "Side.hpp"
+#include "Usings.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// What an uncross did, or would do: everything that crosses trades at one
+// price_, and imbalance_ is what's left over at that price on
+// imbalanceSide_. volume_ is zero when the book wasn't crossed, in which case
+// the price means nothing.
+struct AuctionResult {
+  Price price_{};
+  std::uint64_t volume_{};
+  std::uint64_t imbalance_{};
+  Side imbalanceSide_{Side::Buy};
+};
+
+/**
+ * The single price at which the most quantity can trade, from each side's
+ * levels, best first (bids highest first, asks lowest first).
+ *
+ * At a price p, demand is everything bid at p or higher and supply is
+ * everything offered at p or lower; the volume that clears is the smaller of
+ * the two. Only prices of existing levels between the best ask and the best
+ * bid can maximise it, so those are the only candidates, and both depth
+ * curves are prefix sums over the crossed levels.
+ *
+ * Ties go to the smaller imbalance, then, if buyers are left over, to the
+ * higher price (and otherwise the lower one), as the unfilled side is the one
+ * pushing the price.
+ */
+inline AuctionResult FindClearingPrice(std::span<const LevelInfo> bids,
+                                       std::span<const LevelInfo> asks) {
+  if (bids.empty() || asks.empty() || bids.front().price_ < asks.front().price_)
+    return {};
+
+  const auto highest = bids.front().price_;
+  const auto lowest = asks.front().price_;
+  // Levels outside [lowest, highest] can't be part of any cross
+  std::size_t bidCount{};
+  while (bidCount < bids.size() && bids[bidCount].price_ >= lowest)
+    ++bidCount;
+  std::size_t askCount{};
+  while (askCount < asks.size() && asks[askCount].price_ <= highest)
+    ++askCount;
+
+  auto Cumulative = [](std::span<const LevelInfo> levels) {
+    std::vector<Quantity> quantities(levels.size());
+    for (std::size_t index = 0; index < levels.size(); ++index)
+      quantities[index] = levels[index].quantity_;
+    std::vector<std::uint64_t> sums(levels.size());
+    PrefixSums(quantities, sums);
+    return sums;
+  };
+  const auto demand = Cumulative(bids.first(bidCount));
+  const auto supply = Cumulative(asks.first(askCount));
+
+  std::vector<Price> prices;
+  prices.reserve(bidCount + askCount);
+  for (const auto &level : bids.first(bidCount))
+    prices.push_back(level.price_);
+  for (const auto &level : asks.first(askCount))
+    prices.push_back(level.price_);
+  std::sort(prices.begin(), prices.end());
+  prices.erase(std::unique(prices.begin(), prices.end()), prices.end());
+
+  // Going up in price, asks join the supply from the front of their list and
+  // bids leave the demand from the back of theirs
+  AuctionResult best{};
+  std::size_t asksAtOrBelow{};
+  auto bidsAtOrAbove = bidCount;
+  for (const auto price : prices) {
+    while (asksAtOrBelow < askCount && asks[asksAtOrBelow].price_ <= price)
+      ++asksAtOrBelow;
+    while (bidsAtOrAbove > 0 && bids[bidsAtOrAbove - 1].price_ < price)
+      --bidsAtOrAbove;
+
+    const auto bought = bidsAtOrAbove == 0 ? 0 : demand[bidsAtOrAbove - 1];
+    const auto sold = asksAtOrBelow == 0 ? 0 : supply[asksAtOrBelow - 1];
+    const auto volume = std::min(bought, sold);
+    const auto imbalance = bought > sold ? bought - sold : sold - bought;
+
+    const bool better =
+        volume > best.volume_ ||
+        (volume == best.volume_ && volume != 0 &&
+         (imbalance < best.imbalance_ ||
+          (imbalance == best.imbalance_ && bought > sold)));
+    if (better)
+      best = AuctionResult{price, volume, imbalance,
+                           bought > sold ? Side::Buy : Side::Sell};
+  }
+
+  return best;
+}
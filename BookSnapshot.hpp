@@ -0,0 +1,23 @@
+#pragma once
+
+#include "LevelInfos.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// What readers get from Orderbook::ReadSnapshot(): the top of each side and
+// the order count, as of the end of the last command. Fixed-size and plain,
+// so it can be published through a Seqlock.
+struct BookSnapshot {
+  static constexpr std::size_t MaxDepth = 10;
+
+  // The sequence_ of the last LevelUpdate included
+  std::uint64_t sequence_{};
+  // Same as Orderbook::Size()
+  std::uint64_t orders_{};
+  // How many entries of bids_/asks_ are filled in, best price first
+  std::uint32_t bidDepth_{};
+  std::uint32_t askDepth_{};
+  std::array<LevelInfo, MaxDepth> bids_{};
+  std::array<LevelInfo, MaxDepth> asks_{};
+};
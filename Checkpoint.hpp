@@ -0,0 +1,130 @@
+#pragma once
+
+#include "CheckpointRecord.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Unlike a journal, a checkpoint is all or nothing, so the header records how
+// many orders follow and a short file is rejected rather than trimmed
+struct CheckpointHeader {
+  static constexpr std::uint32_t ExpectedMagic = 0x54504B43; // "CKPT"
+  // 2: accounts and self-trade prevention, 32-bit expiry
+  static constexpr std::uint32_t ExpectedVersion = 2;
+  // Bits of flags_. Older version 2 files always wrote zero here.
+  static constexpr std::uint32_t InAuctionFlag = 1;
+
+  std::uint32_t magic_{ExpectedMagic};
+  std::uint32_t version_{ExpectedVersion};
+  std::uint32_t recordSize_{sizeof(CheckpointRecord)};
+  std::uint32_t flags_{};
+  std::uint64_t count_{};
+  std::uint64_t padding_{};
+};
+
+static_assert(sizeof(CheckpointHeader) == 32);
+
+/**
+ * Writes `records` to `path` in one go, flagged as taken in the call phase
+ * if `inAuction` is set.
+ *
+ * The file is written next to `path` and renamed over it once complete, so a
+ * crash halfway through leaves the previous checkpoint in place.
+ */
+inline void WriteCheckpoint(const std::string &path,
+                            std::span<const CheckpointRecord> records,
+                            bool inAuction = false) {
+  const auto partial = path + ".partial";
+  std::FILE *file = std::fopen(partial.c_str(), "wb");
+  if (file == nullptr)
+    throw std::runtime_error("Could not open checkpoint " + partial +
+                             " for writing.");
+
+  CheckpointHeader header{};
+  header.count_ = records.size();
+  if (inAuction)
+    header.flags_ |= CheckpointHeader::InAuctionFlag;
+  const bool written =
+      std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+      std::fwrite(records.data(), sizeof(CheckpointRecord), records.size(),
+                  file) == records.size() &&
+      std::fflush(file) == 0;
+  std::fclose(file);
+
+  if (!written || std::rename(partial.c_str(), path.c_str()) != 0) {
+    std::remove(partial.c_str());
+    throw std::runtime_error("Could not write checkpoint " + path + ".");
+  }
+}
+
+// Usually straight from Orderbook::Checkpoint()
+inline void WriteCheckpoint(const std::string &path,
+                            const BookCheckpoint &checkpoint) {
+  WriteCheckpoint(path, checkpoint.records_, checkpoint.inAuction_);
+}
+
+// Maps a checkpoint read-only, the same way JournalReader maps a journal, so
+// Orderbook::Restore reads the records straight out of the page cache
+class CheckpointReader {
+private:
+  void *data_{MAP_FAILED};
+  std::size_t size_{};
+  std::size_t count_{};
+  bool inAuction_{false};
+
+public:
+  explicit CheckpointReader(const std::string &path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("Could not open checkpoint " + path + ".");
+
+    struct stat info {};
+    if (::fstat(fd, &info) == 0 &&
+        static_cast<std::size_t>(info.st_size) >= sizeof(CheckpointHeader)) {
+      size_ = static_cast<std::size_t>(info.st_size);
+      data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+
+    if (data_ == MAP_FAILED)
+      throw std::runtime_error("Could not map checkpoint " + path + ".");
+
+    ::madvise(data_, size_, MADV_SEQUENTIAL);
+
+    CheckpointHeader header;
+    std::memcpy(&header, data_, sizeof(header));
+    count_ = header.count_;
+    inAuction_ = (header.flags_ & CheckpointHeader::InAuctionFlag) != 0;
+    if (header.magic_ != CheckpointHeader::ExpectedMagic ||
+        header.version_ != CheckpointHeader::ExpectedVersion ||
+        header.recordSize_ != sizeof(CheckpointRecord) ||
+        size_ != sizeof(header) + count_ * sizeof(CheckpointRecord)) {
+      ::munmap(data_, size_);
+      throw std::runtime_error(path +
+                               " is not a complete checkpoint this build can "
+                               "read.");
+    }
+  }
+
+  CheckpointReader(const CheckpointReader &) = delete;
+  void operator=(const CheckpointReader &) = delete;
+
+  ~CheckpointReader() { ::munmap(data_, size_); }
+
+  std::span<const CheckpointRecord> Records() const {
+    const auto *first = reinterpret_cast<const CheckpointRecord *>(
+        static_cast<const char *>(data_) + sizeof(CheckpointHeader));
+    return {first, count_};
+  }
+
+  // Whether the book was in its call phase; pass it on to Restore
+  bool InAuction() const { return inAuction_; }
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Order.hpp"
+#include "Usings.hpp"
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// One resting order, as Orderbook::Checkpoint() saw it, in a fixed 32-byte
+// layout. A checkpoint is these in FIFO order within each level, so loading
+// them back in sequence rebuilds every queue exactly. Host byte order, like
+// the journal.
+struct CheckpointRecord {
+  OrderId orderId_{};
+  Price price_{};
+  Quantity initialQuantity_{};
+  Quantity remainingQuantity_{};
+  // Seconds since the epoch, as Order keeps it; only meaningful for
+  // GoodForDay and GoodTillDate
+  std::uint32_t expiry_{};
+  AccountId account_{};
+  std::uint8_t orderType_{};
+  std::uint8_t side_{};
+  std::uint8_t selfTradePrevention_{};
+  std::uint8_t reserved_{};
+
+  static CheckpointRecord FromOrder(const Order &order) {
+    return CheckpointRecord{
+        order.GetOrderId(),
+        order.GetPrice(),
+        order.GetInitialQuantity(),
+        order.GetRemainingQuantity(),
+        static_cast<std::uint32_t>(order.GetExpiry().time_since_epoch().count()),
+        order.GetAccount(),
+        static_cast<std::uint8_t>(order.GetOrderType()),
+        static_cast<std::uint8_t>(order.GetSide()),
+        static_cast<std::uint8_t>(order.GetSelfTradePrevention())};
+  }
+
+  Order ToOrder() const {
+    Order order{static_cast<OrderType>(orderType_), orderId_,
+                static_cast<Side>(side_), price_, initialQuantity_,
+                ExpiryTime{std::chrono::seconds{expiry_}}};
+    order.SetAccount(account_,
+                     static_cast<SelfTradePrevention>(selfTradePrevention_));
+    order.Fill(initialQuantity_ - remainingQuantity_);
+    return order;
+  }
+};
+
+static_assert(sizeof(CheckpointRecord) == 32);
+static_assert(std::is_trivially_copyable_v<CheckpointRecord>);
+
+// What Orderbook::Checkpoint() hands back: the resting orders, and whether
+// the book was in its call phase, when crossed orders are to be expected
+struct BookCheckpoint {
+  std::vector<CheckpointRecord> records_;
+  bool inAuction_{false};
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "OrderPool.hpp"
+#include "Usings.hpp"
+#include <chrono>
+#include <map>
+#include <memory_resource>
+#include <vector>
+
+// Orders that expire on their own (GoodForDay, GoodTillDate), bucketed by
+// expiry time.
+//
+// Each bucket is an intrusive FIFO threaded through `links_`, which runs
+// parallel to the OrderPool and is indexed by the same handle. Unlinking a
+// filled or cancelled order is O(1) plus a lookup of its bucket, and expiring
+// a session only ever touches the orders that are actually expiring. There
+// are very few distinct expiry times (every GoodForDay order shares the
+// session close), so the map of buckets stays tiny. Its nodes come from a
+// pool of their own, which ReserveBuckets can fill up front, so a new
+// GoodTillDate deadline doesn't go to the allocator.
+class ExpiryIndex {
+private:
+  struct Links {
+    OrderHandle prev_{OrderPool::InvalidHandle};
+    OrderHandle next_{OrderPool::InvalidHandle};
+  };
+
+  struct Bucket {
+    OrderHandle head_{OrderPool::InvalidHandle};
+    OrderHandle tail_{OrderPool::InvalidHandle};
+  };
+
+  std::pmr::vector<Links> links_;
+  std::pmr::unsynchronized_pool_resource bucketNodes_;
+  std::pmr::map<ExpiryTime, Bucket> buckets_;
+
+public:
+  explicit ExpiryIndex(
+      std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+      : links_{memory}, bucketNodes_{memory}, buckets_{&bucketNodes_} {}
+
+  ExpiryIndex(const ExpiryIndex &) = delete;
+  void operator=(const ExpiryIndex &) = delete;
+
+  // Links for handles below `count` up front, so Insert never resizes
+  void Reserve(std::size_t count) {
+    if (count > links_.size())
+      links_.resize(count);
+  }
+
+  // Builds `expiries` buckets and drops them again, which leaves the node
+  // pool holding enough memory for that many. Only for an empty index.
+  void ReserveBuckets(std::size_t expiries) {
+    for (std::size_t expiry = 0; expiry < expiries; ++expiry)
+      buckets_.try_emplace(ExpiryTime{std::chrono::seconds{expiry}});
+    buckets_.clear();
+  }
+
+  bool Empty() const { return buckets_.empty(); }
+
+  // Only meaningful when !Empty()
+  ExpiryTime Earliest() const { return buckets_.begin()->first; }
+
+  void Insert(OrderHandle handle, ExpiryTime expiry) {
+    if (handle >= links_.size())
+      links_.resize(static_cast<std::size_t>(handle) + 1);
+
+    auto &bucket = buckets_[expiry];
+    auto &links = links_[handle];
+    links.prev_ = bucket.tail_;
+    links.next_ = OrderPool::InvalidHandle;
+
+    if (bucket.head_ == OrderPool::InvalidHandle)
+      bucket.head_ = handle;
+    else
+      links_[bucket.tail_].next_ = handle;
+
+    bucket.tail_ = handle;
+  }
+
+  void Erase(OrderHandle handle, ExpiryTime expiry) {
+    auto bucket = buckets_.find(expiry);
+    auto &links = links_[handle];
+
+    if (links.prev_ == OrderPool::InvalidHandle)
+      bucket->second.head_ = links.next_;
+    else
+      links_[links.prev_].next_ = links.next_;
+
+    if (links.next_ == OrderPool::InvalidHandle)
+      bucket->second.tail_ = links.prev_;
+    else
+      links_[links.next_].prev_ = links.prev_;
+
+    links = Links{};
+
+    if (bucket->second.head_ == OrderPool::InvalidHandle)
+      buckets_.erase(bucket);
+  }
+
+  // The oldest order whose expiry is at or before `now`, if there is one.
+  // Callers are expected to remove it (and so Erase it from here) before
+  // asking again.
+  OrderHandle FirstDue(ExpiryTime now) const {
+    if (buckets_.empty() || buckets_.begin()->first > now)
+      return OrderPool::InvalidHandle;
+    return buckets_.begin()->second.head_;
+  }
+};
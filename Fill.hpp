@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Trade.hpp"
+#include "Usings.hpp"
+#include <vector>
+
+// A trade as one record: both order ids and prices, and the quantity that
+// both sides share, stored once.
+//
+// It's no smaller than a Trade: 28 bytes of naturally aligned fields pad out
+// to the same 32. What it buys is the shape, a flat record to copy onto a
+// wire with no way for the two sides' quantities to disagree.
+struct Fill {
+  OrderId bidOrderId_;
+  OrderId askOrderId_;
+  Price bidPrice_;
+  Price askPrice_;
+  Quantity quantity_;
+
+  static Fill FromTrade(const Trade &trade) {
+    const auto &bid = trade.GetBidTrade();
+    const auto &ask = trade.GetAskTrade();
+    return Fill{bid.orderId_, ask.orderId_, bid.price_, ask.price_,
+                bid.quantity};
+  }
+};
+
+static_assert(sizeof(Fill) == 32);
+
+// Meant to be kept by the caller and handed back call after call: the book
+// clears it before filling it, so its capacity is reused rather than
+// reallocated
+using Fills = std::vector<Fill>;
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// Backing memory for a book's big arrays (the order pool, the order index,
+// the expiry links and the ladder bands) when OrderbookConfig::hugePages_ is
+// set.
+//
+// Anything of at least a huge page is mapped on its own: explicit huge pages
+// if the system has some reserved, otherwise ordinary pages with transparent
+// huge pages requested. Either way every page is touched before the memory
+// is handed out, so the first order to land in a slot doesn't take a page
+// fault, and a 2M-order pool sits in a few hundred TLB entries rather than
+// hundreds of thousands. Smaller allocations, and everything off Linux, just
+// go to new/delete.
+class HugePageResource : public std::pmr::memory_resource {
+public:
+  static constexpr std::size_t HugePageSize = std::size_t{2} << 20;
+
+  // Stateless, so one instance serves every book
+  static HugePageResource *Instance() {
+    static HugePageResource resource;
+    return &resource;
+  }
+
+private:
+  static std::size_t Rounded(std::size_t bytes) {
+    return (bytes + HugePageSize - 1) & ~(HugePageSize - 1);
+  }
+
+  static bool Mapped([[maybe_unused]] std::size_t bytes,
+                     [[maybe_unused]] std::size_t alignment) {
+#ifdef __linux__
+    return bytes >= HugePageSize && alignment <= HugePageSize;
+#else
+    return false;
+#endif
+  }
+
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+    if (!Mapped(bytes, alignment))
+      return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+
+#ifdef __linux__
+    const auto size = Rounded(bytes);
+    auto *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,
+                        -1, 0);
+    if (memory != MAP_FAILED)
+      return memory;
+
+    memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+      throw std::bad_alloc{};
+    // Only advice: without THP this is ordinary memory, which still beats
+    // faulting it in at the open
+    madvise(memory, size, MADV_HUGEPAGE);
+    auto *pages = static_cast<volatile unsigned char *>(memory);
+    for (std::size_t offset = 0; offset < size; offset += 4096)
+      pages[offset] = 0;
+    return memory;
+#else
+    return nullptr; // Mapped() is always false off Linux
+#endif
+  }
+
+  void do_deallocate(void *memory, std::size_t bytes,
+                     std::size_t alignment) override {
+    if (!Mapped(bytes, alignment))
+      return std::pmr::new_delete_resource()->deallocate(memory, bytes,
+                                                         alignment);
+#ifdef __linux__
+    munmap(memory, Rounded(bytes));
+#endif
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override {
+    return this == &other;
+  }
+};
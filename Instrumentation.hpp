@@ -0,0 +1,283 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Where the time goes inside the book, per stage, as latency histograms.
+//
+// The types here are always available; the book only records into them when
+// built with ORDERBOOK_ENABLE_INSTRUMENTATION (the CMake option of the same
+// name). Without it the ORDERBOOK_* macros below expand to nothing and the
+// hot path is exactly what it was.
+//
+// Durations are in ticks of ReadTsc(): TSC cycles on x86, nanoseconds
+// elsewhere.
+
+inline std::uint64_t ReadTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return static_cast<std::uint64_t>(
+      std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+// The sections of the add/cancel/modify path we time. They nest: Match
+// includes the LevelUpdates of every fill it makes.
+enum class Stage : std::uint8_t {
+  LockWait,    // acquiring ordersMutex_ (Locked mode only)
+  Lookup,      // the duplicate check on orders_
+  LevelInsert, // queueing a new order at its level
+  Match,       // MatchOrders, as run after an add or modify
+  LevelUpdate, // UpdateLevelData, once per level change
+};
+inline constexpr std::size_t StageCount = 5;
+
+enum class Counter : std::uint8_t {
+  OrdersAdded,     // orders that made it into the book
+  OrdersCancelled, // cancels of resting orders, expiry included
+  OrdersFilled,    // resting or incoming orders filled completely
+  Trades,
+  LockContended, // LockOrders calls that had to wait
+};
+inline constexpr std::size_t CounterCount = 5;
+
+constexpr std::string_view StageName(Stage stage) {
+  switch (stage) {
+  case Stage::LockWait:
+    return "lock_wait";
+  case Stage::Lookup:
+    return "lookup";
+  case Stage::LevelInsert:
+    return "level_insert";
+  case Stage::Match:
+    return "match";
+  case Stage::LevelUpdate:
+    return "level_update";
+  }
+  return "unknown";
+}
+
+constexpr std::string_view CounterName(Counter counter) {
+  switch (counter) {
+  case Counter::OrdersAdded:
+    return "orders_added";
+  case Counter::OrdersCancelled:
+    return "orders_cancelled";
+  case Counter::OrdersFilled:
+    return "orders_filled";
+  case Counter::Trades:
+    return "trades";
+  case Counter::LockContended:
+    return "lock_contended";
+  }
+  return "unknown";
+}
+
+/**
+ * Log-linear buckets, the way HDR histograms do it: every power of two is
+ * split into 8 equal sub-buckets, so any value is recorded within 12.5% of
+ * its true size, from single ticks up to 2^64, in 496 counters.
+ */
+struct HistogramBuckets {
+  static constexpr int SubBits = 3;
+  static constexpr std::uint64_t SubBuckets = 1u << SubBits;
+  static constexpr std::size_t Count = (64 - SubBits + 1) * SubBuckets;
+
+  static constexpr std::size_t BucketFor(std::uint64_t value) {
+    if (value < SubBuckets)
+      return static_cast<std::size_t>(value);
+    const auto top = 63 - std::countl_zero(value);
+    const auto sub = (value >> (top - SubBits)) & (SubBuckets - 1);
+    return static_cast<std::size_t>((top - SubBits + 1) * SubBuckets + sub);
+  }
+
+  // The smallest value that lands in `bucket`
+  static constexpr std::uint64_t LowerBound(std::size_t bucket) {
+    if (bucket < SubBuckets)
+      return bucket;
+    const auto group = bucket / SubBuckets;
+    const auto sub = bucket % SubBuckets;
+    return (SubBuckets + sub) << (group - 1);
+  }
+};
+
+// A histogram as read at one moment
+struct HistogramSnapshot {
+  std::uint64_t count_{};
+  std::uint64_t sum_{};
+  std::uint64_t max_{};
+  std::array<std::uint64_t, HistogramBuckets::Count> buckets_{};
+
+  double Mean() const {
+    return count_ == 0 ? 0 : static_cast<double>(sum_) / count_;
+  }
+
+  // The upper end of the bucket holding the q-th quantile (0 <= q <= 1),
+  // capped at the largest value seen
+  std::uint64_t Percentile(double q) const {
+    if (count_ == 0)
+      return 0;
+
+    const auto rank = static_cast<std::uint64_t>(q * (count_ - 1)) + 1;
+    std::uint64_t seen{};
+    for (std::size_t bucket = 0; bucket + 1 < buckets_.size(); ++bucket) {
+      seen += buckets_[bucket];
+      if (seen >= rank)
+        return std::min(max_, HistogramBuckets::LowerBound(bucket + 1) - 1);
+    }
+    return max_;
+  }
+};
+
+/**
+ * Recorded by one thread at a time (whoever holds the book), read from any
+ * thread at any time. Every counter is a relaxed atomic, so recording is a
+ * plain load and store and exporting never has to stop the writer; a
+ * snapshot taken mid-record is at most one sample behind.
+ */
+class LatencyHistogram {
+private:
+  std::array<std::atomic<std::uint64_t>, HistogramBuckets::Count> buckets_{};
+  std::atomic<std::uint64_t> sum_{};
+  std::atomic<std::uint64_t> max_{};
+
+  static void Bump(std::atomic<std::uint64_t> &counter, std::uint64_t by) {
+    counter.store(counter.load(std::memory_order_relaxed) + by,
+                  std::memory_order_relaxed);
+  }
+
+public:
+  void Record(std::uint64_t value) {
+    Bump(buckets_[HistogramBuckets::BucketFor(value)], 1);
+    Bump(sum_, value);
+    if (value > max_.load(std::memory_order_relaxed))
+      max_.store(value, std::memory_order_relaxed);
+  }
+
+  HistogramSnapshot Snapshot() const {
+    HistogramSnapshot snapshot;
+    for (std::size_t bucket = 0; bucket < buckets_.size(); ++bucket) {
+      snapshot.buckets_[bucket] =
+          buckets_[bucket].load(std::memory_order_relaxed);
+      snapshot.count_ += snapshot.buckets_[bucket];
+    }
+    snapshot.sum_ = sum_.load(std::memory_order_relaxed);
+    snapshot.max_ = max_.load(std::memory_order_relaxed);
+    return snapshot;
+  }
+};
+
+struct InstrumentationSnapshot {
+  std::array<HistogramSnapshot, StageCount> stages_{};
+  std::array<std::uint64_t, CounterCount> counters_{};
+  HistogramSnapshot tradesPerAdd_{};
+
+  const HistogramSnapshot &Get(Stage stage) const {
+    return stages_[static_cast<std::size_t>(stage)];
+  }
+  std::uint64_t Get(Counter counter) const {
+    return counters_[static_cast<std::size_t>(counter)];
+  }
+
+  // One line per stage and counter, for logs and dashboards
+  void Write(std::ostream &out) const {
+    for (std::size_t index = 0; index < StageCount; ++index) {
+      const auto &stage = stages_[index];
+      out << StageName(static_cast<Stage>(index)) << " count=" << stage.count_
+          << " mean=" << stage.Mean() << " p50=" << stage.Percentile(0.5)
+          << " p99=" << stage.Percentile(0.99)
+          << " p999=" << stage.Percentile(0.999) << " max=" << stage.max_
+          << '\n';
+    }
+    out << "trades_per_add count=" << tradesPerAdd_.count_
+        << " mean=" << tradesPerAdd_.Mean()
+        << " p99=" << tradesPerAdd_.Percentile(0.99)
+        << " max=" << tradesPerAdd_.max_ << '\n';
+    for (std::size_t index = 0; index < CounterCount; ++index)
+      out << CounterName(static_cast<Counter>(index)) << ' '
+          << counters_[index] << '\n';
+  }
+};
+
+class Instrumentation {
+private:
+  std::array<LatencyHistogram, StageCount> stages_{};
+  std::array<std::atomic<std::uint64_t>, CounterCount> counters_{};
+  LatencyHistogram tradesPerAdd_{};
+
+public:
+  void Record(Stage stage, std::uint64_t ticks) {
+    stages_[static_cast<std::size_t>(stage)].Record(ticks);
+  }
+
+  void RecordTradesPerAdd(std::uint64_t trades) {
+    tradesPerAdd_.Record(trades);
+  }
+
+  void Count(Counter counter, std::uint64_t by = 1) {
+    auto &value = counters_[static_cast<std::size_t>(counter)];
+    value.store(value.load(std::memory_order_relaxed) + by,
+                std::memory_order_relaxed);
+  }
+
+  std::uint64_t Get(Counter counter) const {
+    return counters_[static_cast<std::size_t>(counter)].load(
+        std::memory_order_relaxed);
+  }
+
+  InstrumentationSnapshot Snapshot() const {
+    InstrumentationSnapshot snapshot;
+    for (std::size_t index = 0; index < StageCount; ++index)
+      snapshot.stages_[index] = stages_[index].Snapshot();
+    for (std::size_t index = 0; index < CounterCount; ++index)
+      snapshot.counters_[index] =
+          counters_[index].load(std::memory_order_relaxed);
+    snapshot.tradesPerAdd_ = tradesPerAdd_.Snapshot();
+    return snapshot;
+  }
+};
+
+// Records the time from construction to the end of the enclosing scope
+class StageTimer {
+private:
+  Instrumentation &instrumentation_;
+  Stage stage_;
+  std::uint64_t start_{ReadTsc()};
+
+public:
+  StageTimer(Instrumentation &instrumentation, Stage stage)
+      : instrumentation_{instrumentation}, stage_{stage} {}
+  StageTimer(const StageTimer &) = delete;
+  void operator=(const StageTimer &) = delete;
+
+  ~StageTimer() { instrumentation_.Record(stage_, ReadTsc() - start_); }
+};
+
+#ifdef ORDERBOOK_ENABLE_INSTRUMENTATION
+#define ORDERBOOK_INSTRUMENT_CONCAT_(a, b) a##b
+#define ORDERBOOK_INSTRUMENT_CONCAT(a, b) ORDERBOOK_INSTRUMENT_CONCAT_(a, b)
+// Times the rest of the enclosing scope as `stage`
+#define ORDERBOOK_TIME_STAGE(instrumentation, stage)                           \
+  StageTimer ORDERBOOK_INSTRUMENT_CONCAT(stageTimer, __LINE__) {               \
+    instrumentation, stage                                                     \
+  }
+#define ORDERBOOK_COUNT(instrumentation, counter, by)                          \
+  (instrumentation).Count(counter, by)
+// Anything else that only exists in instrumented builds
+#define ORDERBOOK_INSTRUMENT(...) __VA_ARGS__
+#else
+#define ORDERBOOK_TIME_STAGE(instrumentation, stage) static_cast<void>(0)
+#define ORDERBOOK_COUNT(instrumentation, counter, by) static_cast<void>(0)
+#define ORDERBOOK_INSTRUMENT(...)
+#endif
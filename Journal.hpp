@@ -0,0 +1,252 @@
+#pragma once
+
+#include "Order.hpp"
+#include "OrderModify.hpp"
+#include "Usings.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum class JournalRecordType : std::uint8_t {
+  Add,
+  Cancel,
+  Modify,
+  // ExpireOrders ran at time_ and cancelled quantity_ orders (at least one)
+  Expire,
+  BeginAuction,
+  Uncross,
+  // GoodForDay orders added from here on expire at time_. Written when the
+  // book starts and whenever ExpireOrders rolls the close forward.
+  SessionClose,
+};
+
+// One command as the book received it, in a fixed 32-byte layout so a journal
+// is just a header followed by an array of these. Fields are stored in host
+// byte order; journals are meant to be replayed on the machine (or at least
+// the kind of machine) that wrote them.
+//
+// Which fields matter depends on the type, the same way as OrderCommand:
+// - Add: everything, time_ being the order's expiry in seconds since the
+//   epoch (the session close it was given, for GoodForDay)
+// - Modify: orderId_, side_, price_, quantity_
+// - Cancel: orderId_
+// - Expire: time_, in seconds since the epoch, and quantity_, how many
+//   orders the pass cancelled
+// - SessionClose: time_, in seconds since the epoch
+// - BeginAuction, Uncross: nothing
+struct JournalRecord {
+  JournalRecordType type_{JournalRecordType::Add};
+  std::uint8_t orderType_{};
+  std::uint8_t side_{};
+  std::uint8_t selfTradePrevention_{};
+  Price price_{};
+  Quantity quantity_{};
+  // NoAccount in journals written before accounts existed, which is what
+  // these bytes always held
+  AccountId account_{};
+  OrderId orderId_{};
+  std::int64_t time_{};
+
+  static JournalRecord ForAdd(const Order &order) {
+    return JournalRecord{JournalRecordType::Add,
+                         static_cast<std::uint8_t>(order.GetOrderType()),
+                         static_cast<std::uint8_t>(order.GetSide()),
+                         static_cast<std::uint8_t>(
+                             order.GetSelfTradePrevention()),
+                         order.GetPrice(),
+                         order.GetInitialQuantity(),
+                         order.GetAccount(),
+                         order.GetOrderId(),
+                         order.GetExpiry().time_since_epoch().count()};
+  }
+
+  static JournalRecord ForModify(const OrderModify &order) {
+    return JournalRecord{JournalRecordType::Modify,
+                         0,
+                         static_cast<std::uint8_t>(order.GetSide()),
+                         0,
+                         order.GetPrice(),
+                         order.GetQuantity(),
+                         0,
+                         order.GetOrderId()};
+  }
+
+  static JournalRecord ForCancel(OrderId orderId) {
+    JournalRecord record{JournalRecordType::Cancel};
+    record.orderId_ = orderId;
+    return record;
+  }
+
+  static JournalRecord ForExpire(std::chrono::system_clock::time_point now,
+                                 std::size_t expired) {
+    JournalRecord record{JournalRecordType::Expire};
+    record.quantity_ = static_cast<Quantity>(expired);
+    record.time_ = std::chrono::floor<std::chrono::seconds>(now)
+                       .time_since_epoch()
+                       .count();
+    return record;
+  }
+
+  static JournalRecord ForSessionClose(ExpiryTime close) {
+    JournalRecord record{JournalRecordType::SessionClose};
+    record.time_ = close.time_since_epoch().count();
+    return record;
+  }
+
+  static JournalRecord ForBeginAuction() {
+    return JournalRecord{JournalRecordType::BeginAuction};
+  }
+
+  static JournalRecord ForUncross() {
+    return JournalRecord{JournalRecordType::Uncross};
+  }
+
+  Order ToOrder() const {
+    Order order{static_cast<OrderType>(orderType_), orderId_,
+                static_cast<Side>(side_), price_, quantity_,
+                ExpiryTime{std::chrono::seconds{time_}}};
+    order.SetAccount(account_,
+                     static_cast<SelfTradePrevention>(selfTradePrevention_));
+    return order;
+  }
+
+  OrderModify ToOrderModify() const {
+    return OrderModify{orderId_, static_cast<Side>(side_), price_, quantity_};
+  }
+
+  std::chrono::system_clock::time_point ToTime() const {
+    return std::chrono::system_clock::time_point{std::chrono::seconds{time_}};
+  }
+
+  ExpiryTime ToExpiry() const { return ExpiryTime{std::chrono::seconds{time_}}; }
+};
+
+static_assert(sizeof(JournalRecord) == 32);
+static_assert(std::is_trivially_copyable_v<JournalRecord>);
+
+// Written once at the start of every journal so a reader can tell it's looking
+// at one, and at one with the record layout it expects
+struct JournalHeader {
+  static constexpr std::uint32_t ExpectedMagic = 0x4C4E524A; // "JRNL"
+  // 2: SessionClose records, without which GoodForDay orders can't be replayed
+  // 3: Expire records carry how many orders the pass cancelled
+  static constexpr std::uint32_t ExpectedVersion = 3;
+
+  std::uint32_t magic_{ExpectedMagic};
+  std::uint32_t version_{ExpectedVersion};
+  std::uint32_t recordSize_{sizeof(JournalRecord)};
+  std::uint32_t reserved_{};
+};
+
+static_assert(sizeof(JournalHeader) == 16);
+
+/**
+ * Appends records to a journal file, truncating whatever was there before.
+ *
+ * Writes go through a large stdio buffer, so appending is a memcpy most of the
+ * time. Nothing is durable until Flush() (or the destructor) runs; how often
+ * to flush is up to the owner, since it's a trade between latency and how much
+ * a crash can lose.
+ *
+ * An Orderbook built with OrderbookConfig::journal_ appends to it under the
+ * book's own lock, so the writer itself doesn't lock anything.
+ */
+class JournalWriter {
+private:
+  static constexpr std::size_t BufferSize = 1 << 20;
+
+  std::vector<char> buffer_;
+  std::FILE *file_{};
+
+public:
+  explicit JournalWriter(const std::string &path) : buffer_(BufferSize) {
+    file_ = std::fopen(path.c_str(), "wb");
+    if (file_ == nullptr)
+      throw std::runtime_error("Could not open journal " + path +
+                               " for writing.");
+    std::setvbuf(file_, buffer_.data(), _IOFBF, buffer_.size());
+
+    const JournalHeader header{};
+    std::fwrite(&header, sizeof(header), 1, file_);
+  }
+
+  JournalWriter(const JournalWriter &) = delete;
+  void operator=(const JournalWriter &) = delete;
+
+  ~JournalWriter() { std::fclose(file_); }
+
+  void Append(const JournalRecord &record) {
+    std::fwrite(&record, sizeof(record), 1, file_);
+  }
+
+  void Flush() { std::fflush(file_); }
+};
+
+/**
+ * Maps a journal into memory read-only and exposes its records as a span, so
+ * replaying is a straight walk over the file with no parsing and no copies.
+ *
+ * A journal cut short by a crash may end in a partly written record; that
+ * tail is ignored and everything before it is still returned.
+ */
+class JournalReader {
+private:
+  void *data_{MAP_FAILED};
+  std::size_t size_{};
+
+public:
+  explicit JournalReader(const std::string &path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("Could not open journal " + path + ".");
+
+    struct stat info {};
+    if (::fstat(fd, &info) == 0 &&
+        static_cast<std::size_t>(info.st_size) >= sizeof(JournalHeader)) {
+      size_ = static_cast<std::size_t>(info.st_size);
+      data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping keeps the file alive on its own
+    ::close(fd);
+
+    if (data_ == MAP_FAILED)
+      throw std::runtime_error("Could not map journal " + path + ".");
+
+    // We read front to back exactly once, so let the kernel read ahead
+    ::madvise(data_, size_, MADV_SEQUENTIAL);
+
+    JournalHeader header;
+    std::memcpy(&header, data_, sizeof(header));
+    if (header.magic_ != JournalHeader::ExpectedMagic ||
+        header.version_ != JournalHeader::ExpectedVersion ||
+        header.recordSize_ != sizeof(JournalRecord)) {
+      ::munmap(data_, size_);
+      throw std::runtime_error(path + " is not a journal this build can read.");
+    }
+  }
+
+  JournalReader(const JournalReader &) = delete;
+  void operator=(const JournalReader &) = delete;
+
+  ~JournalReader() { ::munmap(data_, size_); }
+
+  std::span<const JournalRecord> Records() const {
+    // The header is 16 bytes and mmap hands back a page-aligned address, so
+    // the records are suitably aligned to be read in place
+    const auto *first = reinterpret_cast<const JournalRecord *>(
+        static_cast<const char *>(data_) + sizeof(JournalHeader));
+    return {first, (size_ - sizeof(JournalHeader)) / sizeof(JournalRecord)};
+  }
+};
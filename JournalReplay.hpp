@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Journal.hpp"
+#include "Orderbook.hpp"
+#include "TradeSink.hpp"
+#include <span>
+
+// Drives a book through a journal, in the order the records were written.
+// Trades come out through `onTrade` exactly as they would have the first time.
+//
+// The session close comes from the journal too, not the replaying book's
+// clock and config, so GoodForDay orders get the expiry they had the first
+// time, whatever day the replay runs on. Expiries happen at the recorded
+// times instead of the wall clock, so a replay into a SingleWriter book
+// (which has no scheduler of its own) ends in the same state as the
+// original. Each pass cancels exactly as many orders as it did the first
+// time, whatever the replaying book's expiryChunk_, so commands that came
+// between two chunks of one expiry see the same book again. A Locked book's scheduler expires by the wall clock, on top of
+// the recorded passes, so it only agrees if the replay runs before anything
+// there comes due.
+inline void ReplayJournal(Orderbook &orderbook,
+                          std::span<const JournalRecord> records,
+                          TradeSink onTrade) {
+  for (const auto &record : records) {
+    switch (record.type_) {
+    case JournalRecordType::Add:
+      orderbook.AddOrder(record.ToOrder(), onTrade);
+      break;
+    case JournalRecordType::Modify:
+      orderbook.ModifyOrder(record.ToOrderModify(), onTrade);
+      break;
+    case JournalRecordType::Cancel:
+      orderbook.CancelOrder(record.orderId_);
+      break;
+    case JournalRecordType::Expire:
+      orderbook.ExpireOrders(record.ToTime(), record.quantity_);
+      break;
+    case JournalRecordType::BeginAuction:
+      orderbook.BeginAuction();
+      break;
+    case JournalRecordType::Uncross:
+      orderbook.Uncross(onTrade);
+      break;
+    case JournalRecordType::SessionClose:
+      orderbook.SetSessionClose(record.ToExpiry());
+      break;
+    }
+  }
+}
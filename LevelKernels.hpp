@@ -0,0 +1,230 @@
+#pragma once
+
+#include "Usings.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Reductions over a run of level quantities, as stored contiguously in the
+// PriceLadder band (best level first, empty levels are zero).
+//
+// Sums are accumulated in 64 bits, since a deep book can hold more than a
+// Quantity's worth. Each kernel has a plain scalar version, which is what you
+// get unless the build targets AVX2 or AVX-512 (-march=native, or the
+// ORDERBOOK_NATIVE_ARCH CMake option).
+
+// Where a running total of the quantities first reaches a target
+struct CumulativeSearch {
+  // Index of the level that takes the total to the target, or the size of the
+  // input if it never gets there
+  std::size_t index_;
+  // The total up to and including index_, or of the whole input if the target
+  // was not reached
+  std::uint64_t total_;
+};
+
+inline std::uint64_t SumQuantitiesScalar(std::span<const Quantity> quantities) {
+  std::uint64_t total{};
+  for (const auto quantity : quantities)
+    total += quantity;
+  return total;
+}
+
+inline CumulativeSearch FindCumulativeScalar(std::span<const Quantity> quantities,
+                                             std::uint64_t target,
+                                             std::uint64_t total = 0,
+                                             std::size_t from = 0) {
+  for (auto index = from; index < quantities.size(); ++index) {
+    total += quantities[index];
+    if (total >= target)
+      return {index, total};
+  }
+  return {quantities.size(), total};
+}
+
+// out[i] = quantities[0] + ... + quantities[i]. `out` must be at least as
+// long as `quantities`.
+inline void PrefixSumsScalar(std::span<const Quantity> quantities,
+                             std::span<std::uint64_t> out) {
+  std::uint64_t total{};
+  for (std::size_t index = 0; index < quantities.size(); ++index)
+    out[index] = total += quantities[index];
+}
+
+#if defined(__AVX512F__)
+
+// 16 quantities per step: widen each half to 8 x u64 and add
+
+inline std::uint64_t SumQuantities(std::span<const Quantity> quantities) {
+  const auto *data = quantities.data();
+  const auto size = quantities.size();
+  auto sums = _mm512_setzero_si512();
+
+  std::size_t index = 0;
+  for (; index + 16 <= size; index += 16) {
+    const auto low = _mm512_cvtepu32_epi64(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + index)));
+    const auto high = _mm512_cvtepu32_epi64(_mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(data + index + 8)));
+    sums = _mm512_add_epi64(sums, _mm512_add_epi64(low, high));
+  }
+
+  return static_cast<std::uint64_t>(_mm512_reduce_add_epi64(sums)) +
+         SumQuantitiesScalar(quantities.subspan(index));
+}
+
+/**
+ * Skip whole blocks of 16 while the running total stays short of the target,
+ * then finish the block that crosses it one level at a time. Most of a deep
+ * level walk is spent in the first loop.
+ */
+inline CumulativeSearch FindCumulative(std::span<const Quantity> quantities,
+                                       std::uint64_t target) {
+  const auto *data = quantities.data();
+  const auto size = quantities.size();
+  std::uint64_t total{};
+
+  std::size_t index = 0;
+  for (; index + 16 <= size; index += 16) {
+    const auto low = _mm512_cvtepu32_epi64(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + index)));
+    const auto high = _mm512_cvtepu32_epi64(_mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(data + index + 8)));
+    const auto block = static_cast<std::uint64_t>(
+        _mm512_reduce_add_epi64(_mm512_add_epi64(low, high)));
+    if (total + block >= target)
+      break;
+    total += block;
+  }
+
+  return FindCumulativeScalar(quantities, target, total, index);
+}
+
+// An in-register scan: add the vector to itself shifted up by 1, 2 and 4
+// lanes, then carry the last lane into the next step
+inline void PrefixSums(std::span<const Quantity> quantities,
+                       std::span<std::uint64_t> out) {
+  const auto *data = quantities.data();
+  const auto size = quantities.size();
+  const auto zero = _mm512_setzero_si512();
+  auto carry = zero;
+
+  std::size_t index = 0;
+  for (; index + 8 <= size; index += 8) {
+    auto sums = _mm512_cvtepu32_epi64(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + index)));
+    sums = _mm512_add_epi64(sums, _mm512_alignr_epi64(sums, zero, 7));
+    sums = _mm512_add_epi64(sums, _mm512_alignr_epi64(sums, zero, 6));
+    sums = _mm512_add_epi64(sums, _mm512_alignr_epi64(sums, zero, 4));
+    sums = _mm512_add_epi64(sums, carry);
+    _mm512_storeu_si512(out.data() + index, sums);
+    carry = _mm512_permutexvar_epi64(_mm512_set1_epi64(7), sums);
+  }
+
+  std::uint64_t total = index == 0 ? 0 : out[index - 1];
+  for (; index < size; ++index)
+    out[index] = total += data[index];
+}
+
+#elif defined(__AVX2__)
+
+// 8 quantities per step: widen each half to 4 x u64 and add
+
+inline std::uint64_t HorizontalSum(__m256i sums) {
+  const auto pairs = _mm_add_epi64(_mm256_castsi256_si128(sums),
+                                   _mm256_extracti128_si256(sums, 1));
+  return static_cast<std::uint64_t>(_mm_cvtsi128_si64(pairs)) +
+         static_cast<std::uint64_t>(_mm_extract_epi64(pairs, 1));
+}
+
+inline __m256i SumBlock(const Quantity *data) {
+  const auto low = _mm256_cvtepu32_epi64(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)));
+  const auto high = _mm256_cvtepu32_epi64(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 4)));
+  return _mm256_add_epi64(low, high);
+}
+
+inline std::uint64_t SumQuantities(std::span<const Quantity> quantities) {
+  const auto *data = quantities.data();
+  const auto size = quantities.size();
+  auto sums = _mm256_setzero_si256();
+
+  std::size_t index = 0;
+  for (; index + 8 <= size; index += 8)
+    sums = _mm256_add_epi64(sums, SumBlock(data + index));
+
+  return HorizontalSum(sums) + SumQuantitiesScalar(quantities.subspan(index));
+}
+
+// Same block skipping as the AVX-512 version, 16 levels at a time
+inline CumulativeSearch FindCumulative(std::span<const Quantity> quantities,
+                                       std::uint64_t target) {
+  const auto *data = quantities.data();
+  const auto size = quantities.size();
+  std::uint64_t total{};
+
+  std::size_t index = 0;
+  for (; index + 16 <= size; index += 16) {
+    const auto block = HorizontalSum(
+        _mm256_add_epi64(SumBlock(data + index), SumBlock(data + index + 8)));
+    if (total + block >= target)
+      break;
+    total += block;
+  }
+
+  return FindCumulativeScalar(quantities, target, total, index);
+}
+
+// An in-register scan: add the vector to itself shifted up by 1 and 2 lanes,
+// then carry the last lane into the next step
+inline void PrefixSums(std::span<const Quantity> quantities,
+                       std::span<std::uint64_t> out) {
+  const auto *data = quantities.data();
+  const auto size = quantities.size();
+  const auto zero = _mm256_setzero_si256();
+  auto carry = zero;
+
+  std::size_t index = 0;
+  for (; index + 4 <= size; index += 4) {
+    auto sums = _mm256_cvtepu32_epi64(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + index)));
+    sums = _mm256_add_epi64(
+        sums, _mm256_blend_epi32(
+                  _mm256_permute4x64_epi64(sums, _MM_SHUFFLE(2, 1, 0, 0)),
+                  zero, 0x03));
+    sums = _mm256_add_epi64(
+        sums, _mm256_blend_epi32(
+                  _mm256_permute4x64_epi64(sums, _MM_SHUFFLE(1, 0, 0, 0)),
+                  zero, 0x0F));
+    sums = _mm256_add_epi64(sums, carry);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out.data() + index), sums);
+    carry = _mm256_permute4x64_epi64(sums, _MM_SHUFFLE(3, 3, 3, 3));
+  }
+
+  std::uint64_t total = index == 0 ? 0 : out[index - 1];
+  for (; index < size; ++index)
+    out[index] = total += data[index];
+}
+
+#else
+
+inline std::uint64_t SumQuantities(std::span<const Quantity> quantities) {
+  return SumQuantitiesScalar(quantities);
+}
+
+inline CumulativeSearch FindCumulative(std::span<const Quantity> quantities,
+                                       std::uint64_t target) {
+  return FindCumulativeScalar(quantities, target);
+}
+
+inline void PrefixSums(std::span<const Quantity> quantities,
+                       std::span<std::uint64_t> out) {
+  PrefixSumsScalar(quantities, out);
+}
+
+#endif
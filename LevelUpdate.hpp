@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Side.hpp"
+#include "Usings.hpp"
+#include <cstdint>
+
+// One market-by-price delta: the new totals of a single level after an order
+// was added to it, cancelled from it, or matched against it. A level whose
+// count drops to zero is gone.
+//
+// Every update the book makes gets the next sequence number, whether or not
+// the consumer had room for it, so a jump in sequence_ means updates were
+// dropped. The way back is a snapshot: GetOrderInfos() is stamped with the
+// sequence of the last update it already reflects.
+struct LevelUpdate {
+  std::uint64_t sequence_{};
+  Price price_{};
+  Quantity quantity_{};
+  Quantity count_{};
+  Side side_{Side::Buy};
+};
@@ -1,11 +1,13 @@
 #pragma once
 
 #include "OrderType.hpp"
+#include "SelfTradePrevention.hpp"
 #include "Side.hpp"
 #include "Usings.hpp"
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <format>
-#include <list>
 #include <memory>
 #include <stdexcept>
 class Order {
@@ -16,14 +18,31 @@ class Order {
 public:
   Order(OrderType orderType, OrderId orderId, Side side, Price price,
         Quantity quantity)
-      : orderType_{orderType}, orderId_{orderId}, side_{side}, price_{price},
-        initialQuantity_{quantity}, remainingQuantity_{quantity} {};
+      : orderId_{orderId}, price_{price}, initialQuantity_{quantity},
+        remainingQuantity_{quantity}, orderType_{orderType}, side_{side} {};
+  // For GoodTillDate orders, which carry their own expiry
+  Order(OrderType orderType, OrderId orderId, Side side, Price price,
+        Quantity quantity, ExpiryTime expiry)
+      : Order(orderType, orderId, side, price, quantity) {
+    SetExpiry(expiry);
+  }
   OrderType GetOrderType() const { return orderType_; }
   OrderId GetOrderId() const { return orderId_; }
   Side GetSide() const { return side_; }
   Price GetPrice() const { return price_; }
   Quantity GetInitialQuantity() const { return initialQuantity_; }
   Quantity GetRemainingQuantity() const { return remainingQuantity_; }
+  ExpiryTime GetExpiry() const {
+    return ExpiryTime{std::chrono::seconds{expiry_}};
+  }
+  AccountId GetAccount() const { return account_; }
+  SelfTradePrevention GetSelfTradePrevention() const {
+    return selfTradePrevention_;
+  }
+  bool HasExpiry() const {
+    return orderType_ == OrderType::GoodForDay ||
+           orderType_ == OrderType::GoodTillDate;
+  }
   Quantity GetFilledQuantity() const {
     return GetInitialQuantity() - GetRemainingQuantity();
   }
@@ -43,16 +62,44 @@ public:
     price_ = price;
     orderType_ = OrderType::GoodTillCancel;
   }
+  // GoodForDay orders expire at whatever the book says the session close is
+  // Stored as 32-bit seconds since the epoch, which lasts until 2106
+  void SetExpiry(ExpiryTime expiry) {
+    expiry_ = static_cast<std::uint32_t>(std::clamp<std::int64_t>(
+        expiry.time_since_epoch().count(), 0, UINT32_MAX));
+  }
+  // Orders of the same account never trade with each other. `mode` is what
+  // happens instead when this is the incoming order.
+  void SetAccount(AccountId account, SelfTradePrevention mode) {
+    account_ = account;
+    selfTradePrevention_ = mode;
+  }
+  // Used by ModifyOrder, which keeps the order's id, type, expiry and slot in
+  // the book. The quantity starts afresh, just like it did back when a modify
+  // was a cancel followed by a brand new order.
+  void Amend(Side side, Price price, Quantity quantity) {
+    side_ = side;
+    price_ = price;
+    initialQuantity_ = quantity;
+    remainingQuantity_ = quantity;
+  }
 
 private:
-  OrderType orderType_;
+  // Widest first, so the whole thing packs into 32 bytes and two orders share
+  // a cache line. The account sits next to the quantities the match loop is
+  // already reading, so checking it costs no extra memory traffic.
   OrderId orderId_;
-  Side side_;
   Price price_;
   Quantity initialQuantity_;
   Quantity remainingQuantity_;
+  std::uint32_t expiry_{};
+  AccountId account_{NoAccount};
+  OrderType orderType_;
+  Side side_;
+  SelfTradePrevention selfTradePrevention_{SelfTradePrevention::None};
 };
 
+static_assert(sizeof(Order) <= 32);
+
 using OrderPointer = std::shared_ptr<Order>;
-using OrderPointers = std::list<OrderPointer>;
 
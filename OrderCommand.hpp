@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Order.hpp"
+#include "OrderModify.hpp"
+#include "OrderType.hpp"
+#include "Side.hpp"
+#include "Usings.hpp"
+#include <chrono>
+#include <cstdint>
+
+enum class CommandType : std::uint8_t {
+  Add,
+  Cancel,
+  Modify,
+  // Expire whatever is due as of when the book applies it. This is how a
+  // scheduler hands an expiry pass to a book it doesn't own.
+  Expire,
+  // Orderbook::BeginAuction and Orderbook::Uncross. Sent to every symbol at
+  // once, these let each OrderbookManager worker run its books' opening
+  // auctions in parallel with the others.
+  BeginAuction,
+  Uncross,
+};
+
+// A fixed-width, plain-value description of something we want the book to do.
+// Unlike Order/OrderModify this never owns anything, so it can be copied
+// through a ring buffer between threads.
+//
+// Which fields matter depends on the type:
+// - Add: everything but symbol_, which is for routing
+// - Modify: orderId_, side_, price_, quantity_ (the type is kept from the
+//   resting order, same as ModifyOrder)
+// - Cancel: orderId_
+// - Expire, BeginAuction, Uncross: nothing
+struct OrderCommand {
+  CommandType type_{CommandType::Add};
+  OrderType orderType_{OrderType::GoodTillCancel};
+  Side side_{Side::Buy};
+  Price price_{};
+  Quantity quantity_{};
+  OrderId orderId_{};
+  // Caller-defined correlation value, echoed back on every report this
+  // command produces
+  std::uint64_t tag_{};
+  // Which book the command is for. Only OrderbookManager looks at this; a
+  // Sequencer has just the one book.
+  SymbolId symbol_{};
+  // Add only: see Order::SetAccount
+  AccountId account_{NoAccount};
+  SelfTradePrevention selfTradePrevention_{SelfTradePrevention::None};
+  // Add only, and only GoodTillDate: seconds since the epoch, as Order keeps
+  // it. Fits in what was padding, so the command is still 48 bytes.
+  std::uint32_t expiry_{};
+
+  static OrderCommand ForAdd(const Order &order, std::uint64_t tag = 0) {
+    OrderCommand command{CommandType::Add,
+                         order.GetOrderType(),
+                         order.GetSide(),
+                         order.GetPrice(),
+                         order.GetInitialQuantity(),
+                         order.GetOrderId(),
+                         tag};
+    command.account_ = order.GetAccount();
+    command.selfTradePrevention_ = order.GetSelfTradePrevention();
+    command.expiry_ = static_cast<std::uint32_t>(
+        order.GetExpiry().time_since_epoch().count());
+    return command;
+  }
+
+  static OrderCommand ForModify(const OrderModify &order,
+                                std::uint64_t tag = 0) {
+    return OrderCommand{CommandType::Modify,
+                        OrderType::GoodTillCancel,
+                        order.GetSide(),
+                        order.GetPrice(),
+                        order.GetQuantity(),
+                        order.GetOrderId(),
+                        tag};
+  }
+
+  static OrderCommand ForCancel(OrderId orderId, std::uint64_t tag = 0) {
+    OrderCommand command{CommandType::Cancel};
+    command.orderId_ = orderId;
+    command.tag_ = tag;
+    return command;
+  }
+
+  Order ToOrder() const {
+    Order order{orderType_, orderId_, side_, price_, quantity_,
+                ExpiryTime{std::chrono::seconds{expiry_}}};
+    order.SetAccount(account_, selfTradePrevention_);
+    return order;
+  }
+
+  OrderModify ToOrderModify() const {
+    return OrderModify{orderId_, side_, price_, quantity_};
+  }
+};
+
+static_assert(sizeof(OrderCommand) == 48);
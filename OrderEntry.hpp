@@ -0,0 +1,322 @@
+#pragma once
+
+#include "Order.hpp"
+#include "OrderCommand.hpp"
+#include "OrderModify.hpp"
+#include "Orderbook.hpp"
+#include "TradeSink.hpp"
+#include "Usings.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+// A fixed-layout binary order-entry protocol, in the spirit of OUCH.
+//
+// A stream is a sequence of frames, each a big-endian u16 payload length
+// followed by the payload. The first payload byte says which message it is,
+// and every field sits at a fixed offset, big-endian:
+//
+//   Enter order 'O' (28 bytes)      Replace order 'U' (20 bytes)
+//    0  type          char           0  type       char
+//    1  order type    char           1  side       char
+//    2  side          char           2  reserved   u16
+//    3  self-trade    char           4  order id   u64
+//    4  account       u32           12  price      i32
+//    8  order id      u64           16  quantity   u32
+//   16  price         i32
+//   20  quantity      u32           Cancel order 'X' (12 bytes)
+//   24  expiry        u32            0  type       char
+//                                    1  reserved   u8[3]
+//                                    4  order id   u64
+//
+// Order types are 'M'arket, good for 'D'ay, good till 'T'ime, good till
+// 'C'ancel, 'I'mmediate or cancel (FillAndKill) and 'F'ill or kill. Sides are
+// 'B' and 'S'. Self-trade prevention is 'N'one, cancel 'C'newest, cancel
+// 'O'ldest or 'D'ecrement both. Expiry is seconds since the epoch, and only
+// read for good till time. A payload may be longer than its message, so
+// fields can be added at the end later; the extra bytes are skipped.
+
+inline constexpr std::size_t OrderEntryHeaderSize = 2;
+inline constexpr std::size_t EnterOrderSize = 28;
+inline constexpr std::size_t ReplaceOrderSize = 20;
+inline constexpr std::size_t CancelOrderSize = 12;
+
+// A frame that can't be an order-entry message. Every frame before it, up to
+// GetOffset() bytes into the buffer, has already been handed on (or applied,
+// through ApplyOrderEntry), so the caller can drop those bytes and decide
+// what to do about the rest.
+class OrderEntryError : public std::runtime_error {
+public:
+  OrderEntryError(const std::string &message, std::size_t offset)
+      : std::runtime_error{message}, offset_{offset} {}
+
+  std::size_t GetOffset() const { return offset_; }
+
+private:
+  std::size_t offset_;
+};
+
+// Helpers for the layouts below
+// Byte by byte, which the compiler turns into a single load and bswap
+template <typename T> T LoadBigEndian(const std::byte *bytes) {
+  std::make_unsigned_t<T> value{};
+  for (std::size_t index = 0; index < sizeof(T); ++index)
+    value = static_cast<std::make_unsigned_t<T>>(
+        (value << 8) | static_cast<std::uint8_t>(bytes[index]));
+  return static_cast<T>(value);
+}
+
+template <typename T> void StoreBigEndian(std::byte *bytes, T value) {
+  auto bits = static_cast<std::make_unsigned_t<T>>(value);
+  for (std::size_t index = sizeof(T); index-- > 0; bits >>= 8)
+    bytes[index] = static_cast<std::byte>(bits & 0xFF);
+}
+
+inline char LoadWireChar(const std::byte *bytes) {
+  return static_cast<char>(*bytes);
+}
+
+inline std::optional<OrderType> OrderTypeFromWire(char wire) {
+  switch (wire) {
+  case 'M':
+    return OrderType::Market;
+  case 'D':
+    return OrderType::GoodForDay;
+  case 'T':
+    return OrderType::GoodTillDate;
+  case 'C':
+    return OrderType::GoodTillCancel;
+  case 'I':
+    return OrderType::FillAndKill;
+  case 'F':
+    return OrderType::FillOrKill;
+  }
+  return std::nullopt;
+}
+
+inline char OrderTypeToWire(OrderType type) {
+  constexpr std::array<char, 6> Wire{'M', 'D', 'T', 'C', 'I', 'F'};
+  return Wire[static_cast<std::size_t>(type)];
+}
+
+inline std::optional<Side> SideFromWire(char wire) {
+  if (wire == 'B')
+    return Side::Buy;
+  if (wire == 'S')
+    return Side::Sell;
+  return std::nullopt;
+}
+
+inline char SideToWire(Side side) { return side == Side::Buy ? 'B' : 'S'; }
+
+inline std::optional<SelfTradePrevention>
+SelfTradePreventionFromWire(char wire) {
+  switch (wire) {
+  case 'N':
+    return SelfTradePrevention::None;
+  case 'C':
+    return SelfTradePrevention::CancelNewest;
+  case 'O':
+    return SelfTradePrevention::CancelOldest;
+  case 'D':
+    return SelfTradePrevention::DecrementBoth;
+  }
+  return std::nullopt;
+}
+
+inline char SelfTradePreventionToWire(SelfTradePrevention mode) {
+  constexpr std::array<char, 4> Wire{'N', 'C', 'O', 'D'};
+  return Wire[static_cast<std::size_t>(mode)];
+}
+
+template <typename T>
+T RequireWireField(std::optional<T> value, const char *field,
+                   std::size_t offset) {
+  if (!value)
+    throw OrderEntryError(
+        std::format("Bad {} in the order-entry frame at byte {}.", field,
+                    offset),
+        offset);
+  return *value;
+}
+
+/**
+ * Decodes every complete frame in `buffer`, in place, into an OrderCommand
+ * and hands it to `onCommand`. Returns how many bytes that used up: a frame
+ * cut off at the end of the buffer is left alone, to be decoded again once
+ * the rest of it has arrived.
+ *
+ * Nothing is copied or allocated. Each field is read straight out of the
+ * receive buffer into the command, which is a plain value on the stack.
+ *
+ * Throws OrderEntryError for a frame that can't be an order-entry message
+ * (an unknown type or enum, or a payload too short for its type), with the
+ * offset of that frame. Everything before it has already been handed on.
+ */
+template <typename OnCommand>
+std::size_t DecodeOrderEntry(std::span<const std::byte> buffer,
+                             OnCommand &&onCommand) {
+  std::size_t offset{};
+  while (buffer.size() - offset >= OrderEntryHeaderSize) {
+    const auto length = LoadBigEndian<std::uint16_t>(buffer.data() + offset);
+    if (buffer.size() - offset - OrderEntryHeaderSize < length)
+      break;
+
+    const auto *payload = buffer.data() + offset + OrderEntryHeaderSize;
+    auto Expect = [&](std::size_t size) {
+      if (length < size)
+        throw OrderEntryError(
+            std::format(
+                "Order-entry frame at byte {} is too short for its type.",
+                offset),
+            offset);
+    };
+    auto Field = [&](auto value, const char *field) {
+      return RequireWireField(value, field, offset);
+    };
+
+    OrderCommand command;
+    switch (length == 0 ? '\0' : LoadWireChar(payload)) {
+    case 'O':
+      Expect(EnterOrderSize);
+      command.type_ = CommandType::Add;
+      command.orderType_ =
+          Field(OrderTypeFromWire(LoadWireChar(payload + 1)), "order type");
+      command.side_ = Field(SideFromWire(LoadWireChar(payload + 2)), "side");
+      command.selfTradePrevention_ = Field(
+          SelfTradePreventionFromWire(LoadWireChar(payload + 3)), "self-trade");
+      command.account_ = LoadBigEndian<AccountId>(payload + 4);
+      command.orderId_ = LoadBigEndian<OrderId>(payload + 8);
+      command.price_ = LoadBigEndian<Price>(payload + 16);
+      command.quantity_ = LoadBigEndian<Quantity>(payload + 20);
+      command.expiry_ = LoadBigEndian<std::uint32_t>(payload + 24);
+      break;
+    case 'U':
+      Expect(ReplaceOrderSize);
+      command.type_ = CommandType::Modify;
+      command.side_ = Field(SideFromWire(LoadWireChar(payload + 1)), "side");
+      command.orderId_ = LoadBigEndian<OrderId>(payload + 4);
+      command.price_ = LoadBigEndian<Price>(payload + 12);
+      command.quantity_ = LoadBigEndian<Quantity>(payload + 16);
+      break;
+    case 'X':
+      Expect(CancelOrderSize);
+      command.type_ = CommandType::Cancel;
+      command.orderId_ = LoadBigEndian<OrderId>(payload + 4);
+      break;
+    default:
+      throw OrderEntryError(
+          std::format("Unknown order-entry message in the frame at byte {}.",
+                      offset),
+          offset);
+    }
+
+    onCommand(command);
+    offset += OrderEntryHeaderSize + length;
+  }
+
+  return offset;
+}
+
+/**
+ * Decodes `buffer` straight into the book, a receive buffer at a time.
+ * Commands are applied through ApplyBatch in runs of up to BatchSize, so a
+ * locked book is locked once per run instead of once per message, and the
+ * trades go to `onTrade` as they happen. Returns the bytes used, as
+ * DecodeOrderEntry does.
+ *
+ * On a bad frame, everything before it is applied before the OrderEntryError
+ * goes on to the caller, so its GetOffset() is where to pick up from. Each
+ * command is handed to the book exactly once: if the book itself throws, the
+ * run it was in is not retried.
+ */
+inline std::size_t ApplyOrderEntry(Orderbook &orderbook,
+                                   std::span<const std::byte> buffer,
+                                   TradeSink onTrade) {
+  constexpr std::size_t BatchSize = 64;
+  std::array<OrderCommand, BatchSize> batch;
+  std::size_t pending{};
+
+  // Emptied before the book sees it, so a throw from ApplyBatch can't have
+  // the catch below apply the same run again
+  auto Flush = [&] {
+    orderbook.ApplyBatch(std::span{batch}.first(std::exchange(pending, 0)),
+                         onTrade);
+  };
+
+  std::size_t used{};
+  try {
+    used = DecodeOrderEntry(buffer, [&](const OrderCommand &command) {
+      batch[pending++] = command;
+      if (pending == BatchSize)
+        Flush();
+    });
+  } catch (...) {
+    // What came before the bad frame still happened
+    Flush();
+    throw;
+  }
+  Flush();
+  return used;
+}
+
+// Encoders for the same layouts, for clients, tools and tests. Each writes
+// one whole frame to the front of `out` and returns its size, or 0 (writing
+// nothing) if `out` is too small.
+
+inline std::size_t EncodeEnterOrder(std::span<std::byte> out,
+                                    const Order &order) {
+  if (out.size() < OrderEntryHeaderSize + EnterOrderSize)
+    return 0;
+
+  auto *payload = out.data() + OrderEntryHeaderSize;
+  StoreBigEndian<std::uint16_t>(out.data(), EnterOrderSize);
+  payload[0] = static_cast<std::byte>('O');
+  payload[1] = static_cast<std::byte>(OrderTypeToWire(order.GetOrderType()));
+  payload[2] = static_cast<std::byte>(SideToWire(order.GetSide()));
+  payload[3] = static_cast<std::byte>(
+      SelfTradePreventionToWire(order.GetSelfTradePrevention()));
+  StoreBigEndian(payload + 4, order.GetAccount());
+  StoreBigEndian(payload + 8, order.GetOrderId());
+  StoreBigEndian(payload + 16, order.GetPrice());
+  StoreBigEndian(payload + 20, order.GetInitialQuantity());
+  StoreBigEndian(payload + 24, static_cast<std::uint32_t>(
+                             order.GetExpiry().time_since_epoch().count()));
+  return OrderEntryHeaderSize + EnterOrderSize;
+}
+
+inline std::size_t EncodeReplaceOrder(std::span<std::byte> out,
+                                      const OrderModify &order) {
+  if (out.size() < OrderEntryHeaderSize + ReplaceOrderSize)
+    return 0;
+
+  auto *payload = out.data() + OrderEntryHeaderSize;
+  StoreBigEndian<std::uint16_t>(out.data(), ReplaceOrderSize);
+  payload[0] = static_cast<std::byte>('U');
+  payload[1] = static_cast<std::byte>(SideToWire(order.GetSide()));
+  StoreBigEndian<std::uint16_t>(payload + 2, 0);
+  StoreBigEndian(payload + 4, order.GetOrderId());
+  StoreBigEndian(payload + 12, order.GetPrice());
+  StoreBigEndian(payload + 16, order.GetQuantity());
+  return OrderEntryHeaderSize + ReplaceOrderSize;
+}
+
+inline std::size_t EncodeCancelOrder(std::span<std::byte> out,
+                                     OrderId orderId) {
+  if (out.size() < OrderEntryHeaderSize + CancelOrderSize)
+    return 0;
+
+  auto *payload = out.data() + OrderEntryHeaderSize;
+  StoreBigEndian<std::uint16_t>(out.data(), CancelOrderSize);
+  payload[0] = static_cast<std::byte>('X');
+  payload[1] = payload[2] = payload[3] = std::byte{0};
+  StoreBigEndian(payload + 4, orderId);
+  return OrderEntryHeaderSize + CancelOrderSize;
+}
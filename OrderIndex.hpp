@@ -0,0 +1,137 @@
+#pragma once
+
+#include "OrderPool.hpp"
+#include "Usings.hpp"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+// OrderId -> OrderHandle, as one flat array of slots with linear probing.
+//
+// std::unordered_map allocates a node per entry and hashes once per call, so
+// "is it there? then erase it" costs two hashes and a free. Here every slot is
+// 16 bytes inline, a lookup is a short walk over adjacent slots, and Erase
+// hands back the handle it removed so callers never look up twice.
+//
+// Keys are spread with a Fibonacci (multiplicative) hash, so the dense,
+// increasing ids a gateway hands out land in neighbouring-but-distinct slots
+// instead of clustering. Deletion shifts later entries of the run back, so
+// there are no tombstones and probe lengths don't degrade under churn.
+class OrderIndex {
+private:
+  struct Slot {
+    OrderId orderId_{};
+    OrderHandle handle_{OrderPool::InvalidHandle};
+
+    bool Empty() const { return handle_ == OrderPool::InvalidHandle; }
+  };
+
+  static constexpr std::size_t MinimumCapacity = 16;
+
+  std::pmr::vector<Slot> slots_;
+  std::size_t mask_{};
+  int shift_{};
+  std::size_t size_{};
+
+  std::size_t Home(OrderId orderId) const {
+    return static_cast<std::size_t>((orderId * 0x9E3779B97F4A7C15ull) >>
+                                    shift_);
+  }
+
+  // The slot holding `orderId`, or the empty slot where it would go
+  std::size_t Probe(OrderId orderId) const {
+    auto index = Home(orderId);
+    while (!slots_[index].Empty() && slots_[index].orderId_ != orderId)
+      index = (index + 1) & mask_;
+    return index;
+  }
+
+  void Rehash(std::size_t capacity) {
+    auto old = std::move(slots_);
+    slots_.assign(capacity, Slot{});
+    mask_ = capacity - 1;
+    shift_ = 64 - std::countr_zero(capacity);
+
+    for (const auto &slot : old) {
+      if (!slot.Empty())
+        slots_[Probe(slot.orderId_)] = slot;
+    }
+  }
+
+public:
+  explicit OrderIndex(
+      std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+      : slots_{memory} {
+    Rehash(MinimumCapacity);
+  }
+
+  std::size_t Size() const { return size_; }
+
+  // Room for `count` orders without growing. We keep the table at most half
+  // full, so probe runs stay short.
+  void Reserve(std::size_t count) {
+    const auto capacity = std::bit_ceil(std::max(count * 2, MinimumCapacity));
+    if (capacity > slots_.size())
+      Rehash(capacity);
+  }
+
+  // Starts pulling in the slot `orderId` hashes to, for bulk loads that know
+  // which ids are coming a few steps ahead
+  void Prefetch(OrderId orderId) const {
+    __builtin_prefetch(&slots_[Home(orderId)], 1);
+  }
+
+  bool Contains(OrderId orderId) const {
+    return !slots_[Probe(orderId)].Empty();
+  }
+
+  // InvalidHandle if the order isn't in the book
+  OrderHandle Find(OrderId orderId) const {
+    return slots_[Probe(orderId)].handle_;
+  }
+
+  // Returns false, and leaves the existing entry alone, if orderId is taken
+  bool Insert(OrderId orderId, OrderHandle handle) {
+    if ((size_ + 1) * 2 > slots_.size())
+      Rehash(slots_.size() * 2);
+
+    auto &slot = slots_[Probe(orderId)];
+    if (!slot.Empty())
+      return false;
+
+    slot = Slot{orderId, handle};
+    ++size_;
+    return true;
+  }
+
+  /**
+   * Removes the order and returns its handle (InvalidHandle if it wasn't
+   * there), all in one probe.
+   *
+   * To keep runs unbroken without tombstones, every later entry of the run
+   * that could have lived in the hole moves back into it.
+   */
+  OrderHandle Erase(OrderId orderId) {
+    auto hole = Probe(orderId);
+    const auto handle = slots_[hole].handle_;
+    if (handle == OrderPool::InvalidHandle)
+      return handle;
+
+    --size_;
+    for (auto next = (hole + 1) & mask_; !slots_[next].Empty();
+         next = (next + 1) & mask_) {
+      // Entries whose home lies cyclically in (hole, next] are already as
+      // close to home as they can be
+      const auto home = Home(slots_[next].orderId_);
+      if (((next - home) & mask_) < ((next - hole) & mask_))
+        continue;
+      slots_[hole] = slots_[next];
+      hole = next;
+    }
+
+    slots_[hole] = Slot{};
+    return handle;
+  }
+};
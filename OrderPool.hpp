@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Order.hpp"
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <vector>
+
+// Orders resting in the book are referred to by their slot in the pool rather
+// than by a shared_ptr. A handle stays valid until the slot is released, even
+// if the underlying storage grows.
+using OrderHandle = std::uint32_t;
+
+// A slab of order slots owned by the Orderbook.
+// Released slots are threaded onto a free list and reused by the next
+// Allocate, so a book at steady state stops touching the allocator entirely.
+class OrderPool {
+public:
+  static constexpr OrderHandle InvalidHandle =
+      std::numeric_limits<OrderHandle>::max();
+
+  explicit OrderPool(
+      std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+      : nodes_{memory} {}
+
+  // Every slot carries the links of the price level FIFO it belongs to. This
+  // makes the level an intrusive doubly-linked list, so we never allocate a
+  // list node and can unlink from the middle in O(1) on cancel.
+  struct Node {
+    Order order_;
+    OrderHandle prev_{InvalidHandle};
+    OrderHandle next_{InvalidHandle};
+  };
+
+  OrderHandle Allocate(const Order &order) {
+    if (freeHead_ == InvalidHandle) {
+      nodes_.push_back(Node{order});
+      return static_cast<OrderHandle>(nodes_.size() - 1);
+    }
+
+    const auto handle = freeHead_;
+    auto &node = nodes_[handle];
+    freeHead_ = node.next_;
+    node = Node{order};
+    return handle;
+  }
+
+  void Release(OrderHandle handle) {
+    auto &node = nodes_[handle];
+    node.prev_ = InvalidHandle;
+    node.next_ = freeHead_;
+    freeHead_ = handle;
+  }
+
+  void Reserve(std::size_t capacity) { nodes_.reserve(capacity); }
+
+  Node &GetNode(OrderHandle handle) { return nodes_[handle]; }
+  const Node &GetNode(OrderHandle handle) const { return nodes_[handle]; }
+  Order &Get(OrderHandle handle) { return nodes_[handle].order_; }
+  const Order &Get(OrderHandle handle) const { return nodes_[handle].order_; }
+
+private:
+  std::pmr::vector<Node> nodes_;
+  OrderHandle freeHead_{InvalidHandle};
+};
+
+// The time-priority queue of a single price level, threaded through the pool.
+// It only stores the two ends; the links themselves live in the pool nodes.
+struct OrderQueue {
+  OrderHandle head_{OrderPool::InvalidHandle};
+  OrderHandle tail_{OrderPool::InvalidHandle};
+
+  bool Empty() const { return head_ == OrderPool::InvalidHandle; }
+  OrderHandle Front() const { return head_; }
+
+  void PushBack(OrderPool &pool, OrderHandle handle) {
+    auto &node = pool.GetNode(handle);
+    node.prev_ = tail_;
+    node.next_ = OrderPool::InvalidHandle;
+
+    if (Empty())
+      head_ = handle;
+    else
+      pool.GetNode(tail_).next_ = handle;
+
+    tail_ = handle;
+  }
+
+  void Erase(OrderPool &pool, OrderHandle handle) {
+    auto &node = pool.GetNode(handle);
+
+    if (node.prev_ == OrderPool::InvalidHandle)
+      head_ = node.next_;
+    else
+      pool.GetNode(node.prev_).next_ = node.next_;
+
+    if (node.next_ == OrderPool::InvalidHandle)
+      tail_ = node.prev_;
+    else
+      pool.GetNode(node.next_).prev_ = node.prev_;
+
+    node.prev_ = OrderPool::InvalidHandle;
+    node.next_ = OrderPool::InvalidHandle;
+  }
+};
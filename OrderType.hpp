@@ -1,12 +1,17 @@
 #pragma once
 
-enum class OrderType {
+#include <cstdint>
+
+enum class OrderType : std::uint8_t {
   // Instructs the broker to buy and sell immediately at the BEST available price.
   // Guarantees execution but not a specific price.
   Market,
   // Limit order that expires at the end of a trading session (i.e. closing time of stock exchange)
   // Advantage: avoids unexpected, unwanted trades for future time periods
   GoodForDay, 
+  // Like GoodForDay, but expires at a date/time chosen by the trader instead
+  // of at the end of the current session
+  GoodTillDate,
   // For long term traders, swing traders, by setting "limit" orders for specific price targets (i.e. buy the dip, if falls to $X)
   // Advantage: don't need to monitor the market
   GoodTillCancel,
@@ -1,86 +1,70 @@
 #include "Orderbook.hpp"
+#include "HugePageResource.hpp"
+#include "Journal.hpp"
 #include "OrderType.hpp"
+#include "Session.hpp"
 #include "Usings.hpp"
+#include <algorithm>
 #include <chrono>
-#include <numeric>
+#include <limits>
+#include <stdexcept>
+#include <thread>
 
 // Private methods
 /**
- * we want to remove the good for day orders at the end of the trading session
- * say 4pm
+ * In SingleWriter mode the book belongs to one thread, so there is nobody to
+ * exclude and we hand back an empty lock instead of touching the mutex.
  */
-void Orderbook::PruneGoodForDayOrders() {
-
-  // This brings the std::chrono namespace into scope so you can use its
-  // contents without typing std::chrono:: every time. Without it:
-  // std::chrono::hours(16)
-  // std::chrono::system_clock::now()
-  // With it:
-  // hours(16)
-  // system_clock::now()
-  using namespace std::chrono;
-  const auto end = hours(16);
-
-  while (true) {
-    const auto now = system_clock::now();
-    const auto now_c = system_clock::to_time_t(now);
-    std::tm now_parts;
-    localtime_r(&now_c, &now_parts);
-
-    if (now_parts.tm_hour >= end.count())
-      now_parts.tm_mday += 1;
-
-    now_parts.tm_hour = end.count();
-    now_parts.tm_min = 0;
-    now_parts.tm_sec = 0;
-
-    auto next = system_clock::from_time_t(mktime(&now_parts));
-    auto till = next - now + milliseconds(100);
-
-    {
-      // In this step, we acquire the lock (other threads cannot use it)
-      std::unique_lock ordersLock{ordersMutex_};
-
-      // Then, we check if there's a shutdown flag called, OR that it is time.
-      // If it isn't time yet, we essentially do a "wait_for" command for that
-      // during until the time of closing (say 1h30m) After this, it "releases"
-      // the lock and other threads can continue using this Then it is now 4pm,
-      // this "reaquires" the lock, preventing others threads from using Orders.
-      // Then it just goes on to prune all GoodForDay orders
-      //
-      // Caveat: wait_for is not the same as while(true) sleep(10). Its not
-      // greedy on the CPU for this.
-      if (shutdown_.load(std::memory_order_acquire) ||
-          shutdownConditionVariable_.wait_for(ordersLock, till) ==
-              std::cv_status::no_timeout)
-        return;
-    }
-
-    OrderIds orderIds;
-
-    {
-      std::scoped_lock ordersLock{ordersMutex_};
-
-      for (const auto &[_, entry] : orders_) {
-        const auto &[order, _] = entry;
-
-        if (order->GetOrderType() != OrderType::GoodForDay)
-          continue;
-
-        orderIds.push_back(order->GetOrderId());
-      }
-    }
+std::unique_lock<std::mutex> Orderbook::LockOrders() const {
+  if (threadingMode_ == ThreadingMode::SingleWriter)
+    return {};
 
-    CancelOrders(orderIds);
+#ifdef ORDERBOOK_ENABLE_INSTRUMENTATION
+  // Try first, so the uncontended case is told apart from the waits
+  const auto start = ReadTsc();
+  std::unique_lock lock{ordersMutex_, std::try_to_lock};
+  if (!lock.owns_lock()) {
+    lock.lock();
+    instrumentation_.Count(Counter::LockContended);
   }
+  instrumentation_.Record(Stage::LockWait, ReadTsc() - start);
+  return lock;
+#else
+  return std::unique_lock{ordersMutex_};
+#endif
 }
 
-void Orderbook::CancelOrders(OrderIds orderIds) {
-  std::scoped_lock ordersLock{ordersMutex_};
+/**
+ * we want to remove the good for day orders at the end of the trading session
+ * say 4pm, along with any GoodTillDate orders as each of them comes due.
+ *
+ * The scheduler calls this on its own thread once the next expiry is due.
+ * It goes through ExpireOrders, which takes the lock for one chunk only, so
+ * matching gets a look in between chunks rather than stalling for the whole
+ * pass. Then we tell the scheduler when to come back.
+ */
+void Orderbook::ExpireDue() {
+  const auto now = std::chrono::system_clock::now();
+  while (ExpireOrders(now) == expiryChunk_)
+    std::this_thread::yield();
+
+  auto ordersLock = LockOrders();
+  scheduledExpiry_ = NextExpiryInternal();
+  scheduler_->Reschedule(schedulerTarget_, scheduledExpiry_);
+}
 
-  for (const auto &orderId : orderIds) {
-    CancelOrderInternal(orderId);
-  }
+// Called under the lock whenever something new may expire
+void Orderbook::ScheduleExpiry(ExpiryTime expiry) {
+  if (!scheduler_ || expiry >= scheduledExpiry_)
+    return;
+  scheduledExpiry_ = expiry;
+  scheduler_->Reschedule(schedulerTarget_, expiry);
+}
+
+ExpiryTime Orderbook::NextExpiryInternal() const {
+  if (expiries_.Empty())
+    return sessionClose_;
+  return std::min(expiries_.Earliest(), sessionClose_);
 }
 
 /**
@@ -89,314 +73,1068 @@ void Orderbook::CancelOrders(OrderIds orderIds) {
  * performant, when we only just acquire one for the duration of the batch
  */
 void Orderbook::CancelOrderInternal(OrderId orderId) {
-  if (!orders_.contains(orderId)) {
+  const auto handle = orders_.Erase(orderId);
+  if (handle == OrderPool::InvalidHandle) {
     return;
   }
 
-  const auto &[order, iterator] = orders_.at(orderId);
-  orders_.erase(orderId);
-
-  if (order->GetSide() == Side::Sell) {
-    // Remove it from the sell side
-    auto price = order->GetPrice();
-    auto &orders = asks_.at(price);
-    orders.erase(iterator);
-    if (orders.empty())
-      asks_.erase(price);
-  } else {
-    // Remove it from the buy side
-    auto price = order->GetPrice();
-    auto &orders = bids_.at(price);
-    orders.erase(iterator);
-    if (orders.empty())
-      bids_.erase(price);
-  }
+  ORDERBOOK_COUNT(instrumentation_, Counter::OrdersCancelled, 1);
+  OnOrderCancelled(pool_.Get(handle));
+  RemoveOrder(handle);
+}
 
-  OnOrderCancelled(order);
+template <Side S> auto &Orderbook::Ladder() {
+  if constexpr (S == Side::Buy)
+    return bids_;
+  else
+    return asks_;
 }
 
-void Orderbook::OnOrderCancelled(OrderPointer order) {
-  UpdateLevelData(order->GetPrice(), order->GetRemainingQuantity(),
-                  LevelData::Action::Remove);
+template <Side S> const auto &Orderbook::Ladder() const {
+  if constexpr (S == Side::Buy)
+    return bids_;
+  else
+    return asks_;
 }
 
-void Orderbook::OnOrderAdded(OrderPointer order) {
-  UpdateLevelData(order->GetPrice(), order->GetInitialQuantity(),
-                  LevelData::Action::Add);
+// Queues the order at the back of its price level
+void Orderbook::LinkOrder(OrderHandle handle) {
+  DispatchSide(pool_.Get(handle).GetSide(), [&](auto side) {
+    Ladder<decltype(side)::value>().PushBack(pool_, handle);
+  });
 }
 
+// Takes the order out of its price level, leaving the slot itself alone
+void Orderbook::UnlinkOrder(OrderHandle handle) {
+  DispatchSide(pool_.Get(handle).GetSide(), [&](auto side) {
+    Ladder<decltype(side)::value>().Erase(pool_, handle);
+  });
+}
+
+/**
+ * Takes an order out of every structure that refers to it by handle and hands
+ * its slot back to the pool. orders_ is left to the caller, which usually
+ * found the handle by erasing it from there.
+ */
+void Orderbook::RemoveOrder(OrderHandle handle) {
+  const auto &order = pool_.Get(handle);
+
+  UnlinkOrder(handle);
+
+  if (order.HasExpiry())
+    expiries_.Erase(handle, order.GetExpiry());
+
+  pool_.Release(handle);
+}
+
+void Orderbook::OnOrderCancelled(const Order &order) {
+  UpdateLevelData(order.GetSide(), order.GetPrice(),
+                  order.GetRemainingQuantity(), LevelData::Action::Remove);
+}
+
+void Orderbook::OnOrderAdded(const Order &order) {
+  UpdateLevelData(order.GetSide(), order.GetPrice(),
+                  order.GetInitialQuantity(), LevelData::Action::Add);
+}
+
+template <Side S>
 void Orderbook::OnOrderMatched(Price price, Quantity quantity,
                                bool isFullyFilled) {
-  UpdateLevelData(price, quantity,
-                  isFullyFilled ? LevelData::Action::Remove
-                                : LevelData::Action::Match);
+  UpdateLevelData<S>(price, quantity,
+                     isFullyFilled ? LevelData::Action::Remove
+                                   : LevelData::Action::Match);
 }
 
 /**
- * Update the book-keeping state
+ * Update the book-keeping state.
+ * The totals live on the level itself, so this has to run while the order is
+ * still queued there: after it's pushed, and before it's erased.
  */
+template <Side S>
 void Orderbook::UpdateLevelData(Price price, Quantity quantity,
                                 LevelData::Action action) {
-  auto &data = data_[price];
-
-  data.count_ += action == LevelData::Action::Remove ? -1
-                 : action == LevelData::Action::Add  ? 1
-                                                     : 0;
-  if (action == LevelData::Action::Remove ||
-      action == LevelData::Action::Match) {
-    data.quantity_ -= quantity;
-  } else {
-    data.quantity_ += quantity;
-  }
+  ORDERBOOK_TIME_STAGE(instrumentation_, Stage::LevelUpdate);
+  const auto level = Ladder<S>().UpdateLevelData(price, quantity, action);
 
-  if (data.count_ == 0)
-    data_.erase(price);
+  ++levelSequence_;
+  if (levelUpdates_)
+    levelUpdates_->TryPush(
+        LevelUpdate{levelSequence_, price, level.quantity_, level.count_, S});
 }
 
-bool Orderbook::CanFullyFill(Side side, Price price, Quantity quantity) const {
-  if (!CanMatch(side, price))
-    return false;
+void Orderbook::UpdateLevelData(Side side, Price price, Quantity quantity,
+                                LevelData::Action action) {
+  DispatchSide(side, [&](auto known) {
+    UpdateLevelData<decltype(known)::value>(price, quantity, action);
+  });
+}
 
-  std::optional<Price> threshold;
+/**
+ * A FillOrKill order can only trade against the opposite side, from the touch
+ * up to its limit price. Each ladder keeps its band totals in one contiguous
+ * array, so this is mostly a vectorised scan (see LevelKernels.hpp) that stops
+ * as soon as enough quantity has been seen.
+ */
+template <Side S>
+bool Orderbook::CanFullyFill(Price price, Quantity quantity) const {
+  return CanMatch<S>(price) &&
+         Ladder<SideTraits<S>::Opposite>().CanFill(price, quantity);
+}
 
-  if (side == Side::Buy) {
-    const auto [askPrice, _] = *asks_.begin();
-    threshold = askPrice;
-  } else {
-    const auto [bidPrice, _] = *bids_.begin();
-    threshold = bidPrice;
-  }
+// Whether the best price on the other side is within our limit. For a buyer
+// that's the lowest ask, since that's the cheapest anyone will sell at.
+// A Market order's price is only a placeholder, so it has no grid to be on
+bool Orderbook::OnTick(const Order &order) const {
+  return tickSize_ == 1 || order.GetOrderType() == OrderType::Market ||
+         order.GetPrice() % tickSize_ == 0;
+}
 
-  for (const auto &[levelPrice, levelData] : data_) {
-    if (threshold.has_value() &&
-            (side == Side::Buy && threshold.value() > levelPrice) ||
-        (side == Side::Sell && threshold.value() < levelPrice))
-      continue;
+/**
+ * CanFullyFill for a FillOrKill order with self-trade prevention on. The level
+ * totals can't say whose quantity is whose, so this walks the orders the
+ * sweep would meet, in the order it would meet them. Our own resting orders
+ * are passed over under CancelOldest, which cancels them on the way; under
+ * CancelNewest or DecrementBoth the first one ends the walk, as that is where
+ * the sweep would stop trading.
+ */
+template <Side S>
+bool Orderbook::CanFullyFillWithoutSelfTrade(const Order &incoming) const {
+  if (!CanMatch<S>(incoming.GetPrice()))
+    return false;
 
-    if ((side == Side::Buy && levelPrice > price) ||
-        (side == Side::Sell && levelPrice < price))
-      continue;
+  const auto &other = Ladder<SideTraits<S>::Opposite>();
+  const bool skipOwn =
+      incoming.GetSelfTradePrevention() == SelfTradePrevention::CancelOldest;
+  std::uint64_t available{};
 
-    if (quantity <= levelData.quantity_)
-      return true;
+  other.ForEachLevel([&](Price price, const LevelData &) {
+    if (!Crosses<S>(incoming.GetPrice(), price))
+      return false;
+    for (auto handle = other.Front(price); handle != OrderPool::InvalidHandle;
+         handle = pool_.GetNode(handle).next_) {
+      const auto &resting = pool_.Get(handle);
+      if (resting.GetAccount() == incoming.GetAccount()) {
+        if (!skipOwn)
+          return false;
+        continue;
+      }
+      available += resting.GetRemainingQuantity();
+      if (available >= incoming.GetInitialQuantity())
+        return false;
+    }
+    return true;
+  });
 
-    quantity -= levelData.quantity_;
-  }
+  return available >= incoming.GetInitialQuantity();
+}
 
-  return false;
+template <Side S> bool Orderbook::CanMatch(Price price) const {
+  const auto &other = Ladder<SideTraits<S>::Opposite>();
+  return !other.Empty() && Crosses<S>(price, *other.Best());
 }
 
-bool Orderbook::CanMatch(Side side, Price price) const {
-  if (side == Side::Buy) {
-    if (asks_.empty())
-      return false;
-    // The . (member access) and -> (member access through pointer) operators
-    // have higher precedence than * (dereference) What You Thought
-    // *asks_.begin()  →  (*asks_).begin()  // You thought this
-    // What It Actually Is
-    // *asks_.begin()  →  *(asks_.begin())  // Dereference the iterator
-    const auto &[bestAsk, _] = *asks_.begin();
-    // We are essentially asking for the lowest ask since Sellers are look to
-    // make their prices higher, so the lowest price by the sellers is the
-    // best price for the Buyers.
-    return price >= bestAsk;
-  } else {
-    if (bids_.empty())
-      return false;
-    const auto &[bestBid, _] = *bids_.begin();
-    return price <= bestBid;
+/**
+ * Both orders are resting and belong to the same account. Does what the
+ * aggressor's SelfTradePrevention says instead of trading, and returns false
+ * if it says to trade anyway.
+ *
+ * Only reached when the accounts match, so it's kept out of line and the
+ * match loop pays one compare for it.
+ */
+bool Orderbook::PreventSelfTrade(OrderHandle aggressor, OrderHandle resting) {
+  auto &incoming = pool_.Get(aggressor);
+  auto &other = pool_.Get(resting);
+
+  switch (incoming.GetSelfTradePrevention()) {
+  case SelfTradePrevention::None:
+    return false;
+  case SelfTradePrevention::CancelNewest:
+    CancelOrderInternal(incoming.GetOrderId());
+    return true;
+  case SelfTradePrevention::CancelOldest:
+    CancelOrderInternal(other.GetOrderId());
+    return true;
+  case SelfTradePrevention::DecrementBoth:
+    break;
   }
-}
 
-Trades Orderbook::MatchOrders() {
-  Trades trades;
-  trades.reserve(orders_.size()); // This prevents too much reallocation
+  // Same bookkeeping as a fill, minus the trade
+  const auto quantity =
+      std::min(incoming.GetRemainingQuantity(), other.GetRemainingQuantity());
+  for (const auto handle : {resting, aggressor}) {
+    auto &order = pool_.Get(handle);
+    order.Fill(quantity);
+    UpdateLevelData(order.GetSide(), order.GetPrice(), quantity,
+                    order.IsFilled() ? LevelData::Action::Remove
+                                     : LevelData::Action::Match);
+    if (order.IsFilled()) {
+      orders_.Erase(order.GetOrderId());
+      RemoveOrder(handle);
+    }
+  }
+  return true;
+}
 
+void Orderbook::MatchOrders(OrderHandle aggressor, TradeSink onTrade) {
   while (true) {
-    if (bids_.empty() || asks_.empty())
+    if (bids_.Empty() || asks_.Empty())
       break;
 
-    auto &[bidPrice, bids] = *bids_.begin();
-    auto &[askPrice, asks] = *asks_.begin();
+    // The touch is cached by the ladders, so re-reading it after every fill
+    // is cheap and means we never hold on to a level that was just erased.
+    const auto bidPrice = *bids_.Best();
+    const auto askPrice = *asks_.Best();
 
     if (bidPrice < askPrice)
       break;
 
-    while (bids.size() && asks.size()) {
-      auto &bid = bids.front();
-      auto &ask = asks.front();
+    const auto bidHandle = bids_.Front(bidPrice);
+    const auto askHandle = asks_.Front(askPrice);
+    auto &bid = pool_.Get(bidHandle);
+    auto &ask = pool_.Get(askHandle);
+
+    // The book was uncrossed before the aggressor came in, so if anything
+    // crosses now, the aggressor is one of these two
+    if (bid.GetAccount() == ask.GetAccount() &&
+        bid.GetAccount() != NoAccount) [[unlikely]] {
+      if (PreventSelfTrade(aggressor,
+                           aggressor == bidHandle ? askHandle : bidHandle))
+        continue;
+    }
 
-      Quantity quantity =
-          std::min(bid->GetRemainingQuantity(), ask->GetRemainingQuantity());
+    Execute(bidHandle, askHandle, bidPrice, askPrice, onTrade);
+  }
+}
 
-      bid->Fill(quantity);
-      ask->Fill(quantity);
+void Orderbook::Execute(OrderHandle bidHandle, OrderHandle askHandle,
+                        Price bidPrice, Price askPrice, TradeSink onTrade) {
+  auto &bid = pool_.Get(bidHandle);
+  auto &ask = pool_.Get(askHandle);
+  Quantity quantity =
+      std::min(bid.GetRemainingQuantity(), ask.GetRemainingQuantity());
+
+  bid.Fill(quantity);
+  ask.Fill(quantity);
+
+  onTrade(Trade{TradeInfo{bid.GetOrderId(), bidPrice, quantity},
+                TradeInfo{ask.GetOrderId(), askPrice, quantity}});
+  ORDERBOOK_COUNT(instrumentation_, Counter::Trades, 1);
+  ORDERBOOK_COUNT(instrumentation_, Counter::OrdersFilled,
+                  bid.IsFilled() + ask.IsFilled());
+
+  OnOrderMatched<Side::Buy>(bid.GetPrice(), quantity, bid.IsFilled());
+  OnOrderMatched<Side::Sell>(ask.GetPrice(), quantity, ask.IsFilled());
+
+  // Filled orders hand their slot back to the pool, so we must be done
+  // reading from them before releasing.
+  if (bid.IsFilled()) {
+    orders_.Erase(bid.GetOrderId());
+    RemoveOrder(bidHandle);
+  }
+  if (ask.IsFilled()) {
+    orders_.Erase(ask.GetOrderId());
+    RemoveOrder(askHandle);
+  }
+}
 
-      if (bid->IsFilled()) {
-        bids.pop_front();
-        orders_.erase(bid->GetOrderId());
-      }
-      if (ask->IsFilled()) {
-        asks.pop_front();
-        orders_.erase(ask->GetOrderId());
-      }
+template <Side S> LevelInfos Orderbook::CrossedLevels() const {
+  constexpr auto Other = SideTraits<S>::Opposite;
+  LevelInfos levels;
+  const auto touch = Ladder<Other>().Best();
+  if (!touch)
+    return levels;
 
-      if (bids.empty()) {
-        bids_.erase(bidPrice);
-      }
-      if (asks.empty()) {
-        asks_.erase(askPrice);
-      }
+  Ladder<S>().ForEachLevel([&](Price price, const LevelData &level) {
+    if (!Crosses<S>(price, *touch))
+      return false;
+    levels.push_back(LevelInfo{price, level.quantity_});
+    return true;
+  });
+  return levels;
+}
+
+AuctionResult Orderbook::IndicativeUncrossInternal() const {
+  return FindClearingPrice(CrossedLevels<Side::Buy>(),
+                           CrossedLevels<Side::Sell>());
+}
+
+void Orderbook::ApplyBeginAuction() {
+  if (journal_)
+    journal_->Append(JournalRecord::ForBeginAuction());
+  auction_ = true;
+}
 
-      trades.push_back(
-          Trade{TradeInfo{bid->GetOrderId(), bid->GetPrice(), quantity},
-                TradeInfo{ask->GetOrderId(), ask->GetPrice(), quantity}});
+/**
+ * Everything bid at or above the clearing price trades with everything
+ * offered at or below it, best price first and oldest first within a level,
+ * until one side runs out at that price. Every trade, both sides, is at the
+ * clearing price.
+ *
+ * Self-trade prevention still applies. An auction has no aggressor, so the
+ * newer order of the pair (the higher id) is the one whose mode decides, and
+ * a prevented self-trade can leave less traded than the result says.
+ */
+AuctionResult Orderbook::ApplyUncross(TradeSink onTrade) {
+  if (journal_)
+    journal_->Append(JournalRecord::ForUncross());
+  auction_ = false;
+
+  const auto result = IndicativeUncrossInternal();
+  if (result.volume_ == 0)
+    return result;
+
+  const auto price = result.price_;
+  while (!bids_.Empty() && !asks_.Empty()) {
+    const auto bidPrice = *bids_.Best();
+    const auto askPrice = *asks_.Best();
+    if (bidPrice < price || askPrice > price)
+      break;
 
-      OnOrderMatched(bid->GetPrice(), quantity, bid->IsFilled());
-      OnOrderMatched(ask->GetPrice(), quantity, ask->IsFilled());
+    const auto bidHandle = bids_.Front(bidPrice);
+    const auto askHandle = asks_.Front(askPrice);
+    const auto &bid = pool_.Get(bidHandle);
+    const auto &ask = pool_.Get(askHandle);
+
+    if (bid.GetAccount() == ask.GetAccount() &&
+        bid.GetAccount() != NoAccount) [[unlikely]] {
+      const auto newer =
+          bid.GetOrderId() > ask.GetOrderId() ? bidHandle : askHandle;
+      if (PreventSelfTrade(newer, newer == bidHandle ? askHandle : bidHandle))
+        continue;
     }
-  }
 
-  if (!bids_.empty()) {
-    auto &[_, bids] = *bids_.begin();
-    auto &order = bids.front();
-    if (order->GetOrderType() == OrderType::FillAndKill)
-      CancelOrderInternal(order->GetOrderId());
+    Execute(bidHandle, askHandle, price, price, onTrade);
   }
 
-  if (!asks_.empty()) {
-    auto &[_, asks] = *asks_.begin();
-    auto &order = asks.front();
-    if (order->GetOrderType() == OrderType::FillAndKill)
-      CancelOrderInternal(order->GetOrderId());
-  }
+  return result;
+}
 
-  return trades;
+
+/**
+ * Called at the end of every public command, still under the lock, so the
+ * snapshot always shows the book between commands and never halfway through
+ * one. Copying out the top levels is a short walk from the touch; anything
+ * past snapshotDepth_ isn't looked at.
+ */
+void Orderbook::PublishSnapshot() {
+  if (snapshotDepth_ == 0)
+    return;
+
+  BookSnapshot snapshot;
+  snapshot.sequence_ = levelSequence_;
+  snapshot.orders_ = orders_.Size();
+
+  auto CollectInto = [this](auto &levels, std::uint32_t &depth) {
+    return [this, &levels, &depth](Price price, const LevelData &level) {
+      if (depth == snapshotDepth_)
+        return false;
+      levels[depth++] = LevelInfo{price, level.quantity_};
+      return true;
+    };
+  };
+
+  bids_.ForEachLevel(CollectInto(snapshot.bids_, snapshot.bidDepth_));
+  asks_.ForEachLevel(CollectInto(snapshot.asks_, snapshot.askDepth_));
+
+  snapshot_.Store(snapshot);
 }
 
 // Public Methods
-Orderbook::Orderbook()
-    : ordersPruneThread_{
-          // [this] { PruneGoodForDayOrders(); } is an anonymous function
-          [this] { PruneGoodForDayOrders(); }} {}
+Orderbook::Orderbook() : Orderbook(OrderbookConfig{}) {}
+
+// Where the book's big arrays come from
+static std::pmr::memory_resource *MemoryFor(const OrderbookConfig &config) {
+  if (config.hugePages_)
+    return HugePageResource::Instance();
+  return std::pmr::get_default_resource();
+}
+
+Orderbook::Orderbook(const OrderbookConfig &config)
+    : bids_{config.priceBandLevels_, config.priceBandBase_, config.tickSize_,
+            MemoryFor(config)},
+      asks_{config.priceBandLevels_, config.priceBandBase_, config.tickSize_,
+            MemoryFor(config)},
+      orders_{MemoryFor(config)}, pool_{MemoryFor(config)},
+      expiries_{MemoryFor(config)},
+      tickSize_{std::max<Price>(config.tickSize_, 1)},
+      sessionClose_{std::chrono::floor<std::chrono::seconds>(NextSessionClose(
+          std::chrono::system_clock::now(), config.sessionClose_))},
+      sessionCloseTime_{config.sessionClose_},
+      expiryChunk_{std::max<std::size_t>(config.expiryChunk_, 1)},
+      threadingMode_{config.threadingMode_}, journal_{config.journal_},
+      snapshotDepth_{std::min(config.snapshotDepth_, BookSnapshot::MaxDepth)} {
+  // Everything the open is going to need, allocated and touched now rather
+  // than one rehash or page fault at a time while the burst is coming in
+  pool_.Reserve(config.expectedOrders_);
+  orders_.Reserve(config.expectedOrders_);
+  expiries_.Reserve(config.expectedOrders_);
+  expiries_.ReserveBuckets(config.expectedExpiries_);
+  bids_.ReserveOverflow(config.expectedLevels_);
+  asks_.ReserveOverflow(config.expectedLevels_);
+
+  // A replay starts from the close this book started with, not its own
+  if (journal_)
+    journal_->Append(JournalRecord::ForSessionClose(sessionClose_));
+
+  if (config.levelUpdateCapacity_ != 0)
+    levelUpdates_ =
+        std::make_unique<SpscRing<LevelUpdate>>(config.levelUpdateCapacity_);
+
+  // A single-writer book is driven entirely by its owning thread, which is
+  // also responsible for expiring orders (see Sequencer.hpp)
+  if (threadingMode_ == ThreadingMode::Locked) {
+    scheduler_ = std::make_unique<SessionScheduler>();
+    // [this] { ExpireDue(); } is an anonymous function
+    schedulerTarget_ = scheduler_->Register([this] { ExpireDue(); });
+    ScheduleExpiry(NextExpiryInternal());
+    scheduler_->Start();
+  }
+}
 
 /**
  * This is a destructor function
  */
 Orderbook::~Orderbook() {
-  // sets a flag to tell the prune thread to stop 
-  shutdown_.store(true, std::memory_order_release);
-  // Wakes up the thread if its sleeping in "wait_for" 
-  shutdownConditionVariable_.notify_one();
-  ordersPruneThread_.join();
+  // Waits for an expiry pass that's already running, but never for the lock
+  if (scheduler_)
+    scheduler_->Stop();
+}
+
+Trades Orderbook::AddOrder(OrderPointer order) { return AddOrder(*order); }
+
+Trades Orderbook::AddOrder(const Order &order) {
+  Trades trades;
+  AddOrder(order, [&trades](const Trade &trade) { trades.push_back(trade); });
+  return trades;
 }
 
-Trades Orderbook::AddOrder(OrderPointer order) {
-  std::scoped_lock ordersLock{ordersMutex_};
+void Orderbook::AddOrder(const Order &order, TradeSink onTrade) {
+  auto ordersLock = LockOrders();
+  ApplyAdd(order, onTrade);
+  PublishSnapshot();
+}
+
+void Orderbook::AddOrder(const Order &order, Fills &fills) {
+  fills.clear();
+  AddOrder(order, [&fills](const Trade &trade) {
+    fills.push_back(Fill::FromTrade(trade));
+  });
+}
 
+// Everything AddOrder does once it holds the lock
+void Orderbook::ApplyAdd(const Order &order, TradeSink onTrade) {
   // If the orders already contains this specific order, we ignore
-  if (orders_.contains(order->GetOrderId())) {
-    return {};
+  {
+    ORDERBOOK_TIME_STAGE(instrumentation_, Stage::Lookup);
+    if (orders_.Contains(order.GetOrderId()))
+      return;
   }
 
-  if (order->GetOrderType() == OrderType::Market) {
-    if (order->GetSide() == Side::Buy && !asks_.empty()) {
-      const auto &[worstAsk, _] = *asks_.rbegin();
-      order->ToGoodTillCancel(worstAsk);
-    } else if (order->GetSide() == Side::Sell && !bids_.empty()) {
-      const auto &[worstBid, _] = *bids_.rbegin();
-      order->ToGoodTillCancel(worstBid);
-    } else
-      return {};
+  if (!OnTick(order))
+    return;
+
+  if (auction_ && (order.GetOrderType() == OrderType::Market ||
+                   order.GetOrderType() == OrderType::FillAndKill ||
+                   order.GetOrderType() == OrderType::FillOrKill))
+    return;
+
+  if (journal_) {
+    auto record = JournalRecord::ForAdd(order);
+    if (order.GetOrderType() == OrderType::GoodForDay)
+      record.time_ = sessionClose_.time_since_epoch().count();
+    journal_->Append(record);
   }
 
-  if (order->GetOrderType() == OrderType::FillAndKill &&
-      !CanMatch(order->GetSide(), order->GetPrice()))
-    return {};
+  // One switch on the way in picks the path for this side and order type;
+  // from there on every check compiles down to what that pair needs
+  DispatchSide(order.GetSide(), [&](auto side) {
+    constexpr auto S = decltype(side)::value;
+
+    switch (order.GetOrderType()) {
+    case OrderType::Market:
+      return AddAs<S, OrderType::Market>(order, onTrade);
+    case OrderType::GoodForDay:
+      return AddAs<S, OrderType::GoodForDay>(order, onTrade);
+    case OrderType::GoodTillDate:
+      return AddAs<S, OrderType::GoodTillDate>(order, onTrade);
+    case OrderType::GoodTillCancel:
+      return AddAs<S, OrderType::GoodTillCancel>(order, onTrade);
+    case OrderType::FillAndKill:
+      return AddAs<S, OrderType::FillAndKill>(order, onTrade);
+    case OrderType::FillOrKill:
+      return AddAs<S, OrderType::FillOrKill>(order, onTrade);
+    }
+  });
+}
 
-  if (order->GetOrderType() == OrderType::FillOrKill &&
-      !CanFullyFill(order->GetSide(), order->GetPrice(),
-                    order->GetInitialQuantity()))
-    return {};
+/**
+ * Takes liquidity from the other side, best level first, until the incoming
+ * order is filled, the other side runs out, or (for anything but a Market
+ * order) the next level is past its limit.
+ *
+ * A Market order has no price of its own, so its side of each trade is
+ * reported at the price it traded at.
+ */
+template <Side S, OrderType Type>
+void Orderbook::Sweep(Order &incoming, TradeSink onTrade) {
+  constexpr auto Other = SideTraits<S>::Opposite;
+  auto &other = Ladder<Other>();
+
+  while (!incoming.IsFilled() && !other.Empty()) {
+    const auto price = *other.Best();
+    if constexpr (Type != OrderType::Market) {
+      if (!Crosses<S>(incoming.GetPrice(), price))
+        break;
+    }
 
-  OrderPointers::iterator iterator;
+    const auto handle = other.Front(price);
+    auto &resting = pool_.Get(handle);
+    const auto quantity =
+        std::min(incoming.GetRemainingQuantity(), resting.GetRemainingQuantity());
+
+    if (resting.GetAccount() == incoming.GetAccount() &&
+        incoming.GetAccount() != NoAccount &&
+        incoming.GetSelfTradePrevention() != SelfTradePrevention::None)
+        [[unlikely]] {
+      switch (incoming.GetSelfTradePrevention()) {
+      case SelfTradePrevention::CancelNewest:
+        // The incoming order never rested, so dropping it is all it takes
+        return;
+      case SelfTradePrevention::CancelOldest:
+        CancelOrderInternal(resting.GetOrderId());
+        continue;
+      default:
+        // DecrementBoth: the same bookkeeping as a fill, minus the trade
+        incoming.Fill(quantity);
+        resting.Fill(quantity);
+        OnOrderMatched<Other>(price, quantity, resting.IsFilled());
+        if (resting.IsFilled()) {
+          orders_.Erase(resting.GetOrderId());
+          RemoveOrder(handle);
+        }
+        continue;
+      }
+    }
 
-  if (order->GetSide() == Side::Buy) {
-    auto &orders = bids_[order->GetPrice()];
-    orders.push_back(order);
-    iterator = std::next(orders.begin(), orders.size() - 1);
-  } else {
-    auto &orders = asks_[order->GetPrice()];
-    orders.push_back(order);
-    iterator = std::next(orders.begin(), orders.size() - 1);
+    incoming.Fill(quantity);
+    resting.Fill(quantity);
+
+    const TradeInfo taker{incoming.GetOrderId(),
+                          Type == OrderType::Market ? price
+                                                    : incoming.GetPrice(),
+                          quantity};
+    const TradeInfo maker{resting.GetOrderId(), price, quantity};
+    if constexpr (S == Side::Buy)
+      onTrade(Trade{taker, maker});
+    else
+      onTrade(Trade{maker, taker});
+    ORDERBOOK_COUNT(instrumentation_, Counter::Trades, 1);
+    ORDERBOOK_COUNT(instrumentation_, Counter::OrdersFilled,
+                    resting.IsFilled() + incoming.IsFilled());
+
+    OnOrderMatched<Other>(price, quantity, resting.IsFilled());
+
+    if (resting.IsFilled()) {
+      orders_.Erase(resting.GetOrderId());
+      RemoveOrder(handle);
+    }
   }
+}
 
-  orders_.insert({order->GetOrderId(), OrderEntry{order, iterator}});
+/**
+ * The book keeps its own copy of the order in pool_, so any conversion we do
+ * here doesn't leak back into the caller's object.
+ */
+template <Side S, OrderType Type>
+void Orderbook::AddAs(Order incoming, TradeSink onTrade) {
+  if constexpr (Type == OrderType::Market || Type == OrderType::FillAndKill ||
+                Type == OrderType::FillOrKill) {
+    // None of these can rest, so they never go near their own side of the
+    // book: they trade against the other side and whatever is left is gone
+    if constexpr (Type == OrderType::FillOrKill) {
+      const bool preventsSelfTrade =
+          incoming.GetAccount() != NoAccount &&
+          incoming.GetSelfTradePrevention() != SelfTradePrevention::None;
+      if (preventsSelfTrade
+              ? !CanFullyFillWithoutSelfTrade<S>(incoming)
+              : !CanFullyFill<S>(incoming.GetPrice(),
+                                 incoming.GetInitialQuantity()))
+        return;
+    }
 
-  OnOrderAdded(order);
+    ORDERBOOK_INSTRUMENT(
+        const auto tradesBefore = instrumentation_.Get(Counter::Trades));
+    {
+      ORDERBOOK_TIME_STAGE(instrumentation_, Stage::Match);
+      Sweep<S, Type>(incoming, onTrade);
+    }
+    ORDERBOOK_INSTRUMENT(instrumentation_.RecordTradesPerAdd(
+        instrumentation_.Get(Counter::Trades) - tradesBefore));
+    return;
+  } else if constexpr (Type == OrderType::GoodForDay) {
+    incoming.SetExpiry(sessionClose_);
+  }
+
+  const auto handle = pool_.Allocate(incoming);
+
+  // The level has to exist before UpdateLevelData can touch its totals
+  {
+    ORDERBOOK_TIME_STAGE(instrumentation_, Stage::LevelInsert);
+    Ladder<S>().PushBack(pool_, handle);
+  }
 
-  return MatchOrders();
+  orders_.Insert(incoming.GetOrderId(), handle);
+  ORDERBOOK_COUNT(instrumentation_, Counter::OrdersAdded, 1);
+
+  if constexpr (Type == OrderType::GoodForDay ||
+                Type == OrderType::GoodTillDate) {
+    expiries_.Insert(handle, incoming.GetExpiry());
+    ScheduleExpiry(incoming.GetExpiry());
+  }
+
+  UpdateLevelData<S>(incoming.GetPrice(), incoming.GetInitialQuantity(),
+                     LevelData::Action::Add);
+
+  // In the call phase orders only queue up; Uncross matches them all at once
+  if (auction_) [[unlikely]]
+    return;
+
+  ORDERBOOK_INSTRUMENT(
+      const auto tradesBefore = instrumentation_.Get(Counter::Trades));
+  {
+    ORDERBOOK_TIME_STAGE(instrumentation_, Stage::Match);
+    MatchOrders(handle, onTrade);
+  }
+  ORDERBOOK_INSTRUMENT(instrumentation_.RecordTradesPerAdd(
+      instrumentation_.Get(Counter::Trades) - tradesBefore));
 }
 
 void Orderbook::CancelOrder(OrderId orderId) {
-  std::scoped_lock ordersLock{ordersMutex_};
+  auto ordersLock = LockOrders();
+  ApplyCancel(orderId);
+  PublishSnapshot();
+}
+
+// A cancel the caller asked for, as opposed to one the book does itself on
+// expiry, which isn't journaled
+void Orderbook::ApplyCancel(OrderId orderId) {
+  if (journal_ && orders_.Contains(orderId))
+    journal_->Append(JournalRecord::ForCancel(orderId));
 
   CancelOrderInternal(orderId);
 }
 
 Trades Orderbook::ModifyOrder(OrderModify order) {
-  OrderType orderType;
+  Trades trades;
+  ModifyOrder(order,
+              [&trades](const Trade &trade) { trades.push_back(trade); });
+  return trades;
+}
 
-  // We acquire the mutex in this scope so that we don't reaquire the mutex in
-  // CancelOrder and AddOrder. Both of them use the same mutex This could
-  // potentially lead to a DEADLOCK.
-  {
-    std::scoped_lock ordersLock{ordersMutex_};
+/**
+ * The whole modify runs under one lock, so there is no window between taking
+ * the order out and putting it back for another thread to slip into.
+ *
+ * The order never leaves its pool slot. Shrinking it at the same price is done
+ * in place and keeps its place in the queue, which is how exchanges treat a
+ * quantity-down amend. Anything else (a new price, a new side, or more
+ * quantity) sends it to the back of its new level, as a fresh order would be,
+ * and may then cross the book.
+ */
+void Orderbook::ModifyOrder(OrderModify order, TradeSink onTrade) {
+  auto ordersLock = LockOrders();
+  if (ApplyModify(order, onTrade))
+    PublishSnapshot();
+}
+
+void Orderbook::ModifyOrder(OrderModify order, Fills &fills) {
+  fills.clear();
+  ModifyOrder(order, [&fills](const Trade &trade) {
+    fills.push_back(Fill::FromTrade(trade));
+  });
+}
+
+// Returns false if there was nothing to do, so the caller can skip
+// republishing the snapshot
+bool Orderbook::ApplyModify(const OrderModify &order, TradeSink onTrade) {
+  const auto handle = orders_.Find(order.GetOrderId());
+  if (handle == OrderPool::InvalidHandle ||
+      (tickSize_ != 1 && order.GetPrice() % tickSize_ != 0))
+    return false;
+
+  auto &resting = pool_.Get(handle);
+  const bool inPlace = order.GetSide() == resting.GetSide() &&
+                       order.GetPrice() == resting.GetPrice() &&
+                       order.GetQuantity() <= resting.GetRemainingQuantity();
+
+  // Same side, price and quantity: no journal record, and no level update for
+  // a feed consumer to see a zero delta in
+  if (inPlace && order.GetQuantity() == resting.GetRemainingQuantity())
+    return false;
+
+  if (journal_)
+    journal_->Append(JournalRecord::ForModify(order));
+
+  // Modifying down to nothing is a cancel; leaving an empty order resting
+  // would only get it matched for zero
+  if (order.GetQuantity() == 0) {
+    CancelOrderInternal(order.GetOrderId());
+    return true;
+  }
+
+  if (inPlace) {
+    // For the level totals this is no different to a partial fill
+    UpdateLevelData(resting.GetSide(), resting.GetPrice(),
+                    resting.GetRemainingQuantity() - order.GetQuantity(),
+                    LevelData::Action::Match);
+    resting.Amend(order.GetSide(), order.GetPrice(), order.GetQuantity());
+    return true;
+  }
+
+  // The expiry index is keyed by handle and expiry, neither of which changes,
+  // so only the price level needs redoing
+  OnOrderCancelled(resting);
+  UnlinkOrder(handle);
+
+  resting.Amend(order.GetSide(), order.GetPrice(), order.GetQuantity());
+
+  LinkOrder(handle);
+  OnOrderAdded(resting);
+
+  if (auction_) [[unlikely]]
+    return true;
+
+  ORDERBOOK_TIME_STAGE(instrumentation_, Stage::Match);
+  MatchOrders(handle, onTrade);
+  return true;
+}
+
+void Orderbook::AddOrders(std::span<const OrderPointer> orders,
+                          Trades &trades) {
+  auto ordersLock = LockOrders();
+  orders_.Reserve(orders_.Size() + orders.size());
+
+  for (const auto &order : orders)
+    ApplyAdd(*order,
+             [&trades](const Trade &trade) { trades.push_back(trade); });
+
+  PublishSnapshot();
+}
+
+void Orderbook::ApplyBatch(std::span<const OrderCommand> commands,
+                           Trades &trades) {
+  ApplyBatch(commands,
+             [&trades](const Trade &trade) { trades.push_back(trade); });
+}
+
+void Orderbook::ApplyBatch(std::span<const OrderCommand> commands,
+                           Fills &fills) {
+  fills.clear();
+  ApplyBatch(commands, [&fills](const Trade &trade) {
+    fills.push_back(Fill::FromTrade(trade));
+  });
+}
+
+/**
+ * One lock for the whole packet. Commands still run strictly one after the
+ * other, each matching before the next is looked at, so the outcome is the
+ * same as making the calls one by one; only the per-call overhead goes.
+ */
+void Orderbook::ApplyBatch(std::span<const OrderCommand> commands,
+                           TradeSink onTrade) {
+  auto ordersLock = LockOrders();
+
+  for (const auto &command : commands) {
+    switch (command.type_) {
+    case CommandType::Add:
+      ApplyAdd(command.ToOrder(), onTrade);
+      break;
+    case CommandType::Modify:
+      ApplyModify(command.ToOrderModify(), onTrade);
+      break;
+    case CommandType::Cancel:
+      ApplyCancel(command.orderId_);
+      break;
+    case CommandType::Expire:
+      ApplyExpire(std::chrono::system_clock::now(), expiryChunk_);
+      break;
+    case CommandType::BeginAuction:
+      ApplyBeginAuction();
+      break;
+    case CommandType::Uncross:
+      ApplyUncross(onTrade);
+      break;
+    }
+  }
+
+  PublishSnapshot();
+}
 
-    if (!orders_.contains(order.GetOrderId()))
-      return {};
+void Orderbook::BeginAuction() {
+  auto ordersLock = LockOrders();
+  ApplyBeginAuction();
+}
+
+AuctionResult Orderbook::Uncross(TradeSink onTrade) {
+  auto ordersLock = LockOrders();
+  const auto result = ApplyUncross(onTrade);
+  PublishSnapshot();
+  return result;
+}
+
+bool Orderbook::InAuction() const {
+  auto ordersLock = LockOrders();
+  return auction_;
+}
+
+AuctionResult Orderbook::GetIndicativeUncross() const {
+  auto ordersLock = LockOrders();
+  return IndicativeUncrossInternal();
+}
+
+ExpiryTime Orderbook::NextExpiry() const {
+  auto ordersLock = LockOrders();
+  return NextExpiryInternal();
+}
 
-    const auto &[existingOrder, _] = orders_.at(order.GetOrderId());
-    orderType = existingOrder->GetOrderType();
+std::size_t Orderbook::ExpireOrders(std::chrono::system_clock::time_point now) {
+  return ExpireOrders(now, expiryChunk_);
+}
+
+std::size_t Orderbook::ExpireOrders(std::chrono::system_clock::time_point now,
+                                    std::size_t limit) {
+  auto ordersLock = LockOrders();
+  const auto expired = ApplyExpire(now, limit);
+  if (expired != 0)
+    PublishSnapshot();
+  return expired;
+}
+
+std::size_t Orderbook::ApplyExpire(std::chrono::system_clock::time_point now,
+                                   std::size_t limit) {
+  const auto due = std::chrono::floor<std::chrono::seconds>(now);
+
+  // GoodForDay orders already resting keep the expiry they were given, so a
+  // new session only affects orders added from here on
+  if (due >= sessionClose_)
+    ApplySessionClose(std::chrono::floor<std::chrono::seconds>(
+        NextSessionClose(now, sessionCloseTime_)));
+
+  std::size_t expired{};
+  for (; expired < limit; ++expired) {
+    const auto handle = expiries_.FirstDue(due);
+    if (handle == OrderPool::InvalidHandle)
+      break;
+    CancelOrderInternal(pool_.Get(handle).GetOrderId());
   }
 
-  CancelOrder(order.GetOrderId());
-  return AddOrder(order.ToOrderPointer(orderType));
+  // Written after the fact, but nothing else can get in while we hold the
+  // lock, so it still lands in the right place relative to other commands.
+  // The count goes with it, as a replay may have a different chunk size.
+  if (journal_ && expired != 0)
+    journal_->Append(JournalRecord::ForExpire(now, expired));
+
+  return expired;
+}
+
+void Orderbook::SetSessionClose(ExpiryTime close) {
+  auto ordersLock = LockOrders();
+  ApplySessionClose(close);
+}
+
+// Journaled, since which close a GoodForDay order gets depends on the clock
+// and the config, and a replay may have neither
+void Orderbook::ApplySessionClose(ExpiryTime close) {
+  sessionClose_ = close;
+  if (journal_)
+    journal_->Append(JournalRecord::ForSessionClose(close));
+  ScheduleExpiry(close);
+}
+
+BookCheckpoint Orderbook::Checkpoint() const {
+  auto ordersLock = LockOrders();
+
+  BookCheckpoint checkpoint{{}, auction_};
+  auto &records = checkpoint.records_;
+  records.reserve(orders_.Size());
+
+  auto CollectFrom = [this, &records](const auto &ladder) {
+    ladder.ForEachLevel([&](Price price, const LevelData &) {
+      for (auto handle = ladder.Front(price); handle != OrderPool::InvalidHandle;
+           handle = pool_.GetNode(handle).next_)
+        records.push_back(CheckpointRecord::FromOrder(pool_.Get(handle)));
+      return true;
+    });
+  };
+
+  CollectFrom(bids_);
+  CollectFrom(asks_);
+  return checkpoint;
+}
+
+/**
+ * A warm start. Nothing here matches or journals: the orders go straight into
+ * the pool, the index and the back of their levels, so the cost is a few
+ * stores per order.
+ *
+ * The records are checked up front, and the index is filled before any level
+ * is touched, so a bad checkpoint can be backed out completely.
+ */
+void Orderbook::Restore(std::span<const CheckpointRecord> records,
+                        bool inAuction) {
+  auto ordersLock = LockOrders();
+
+  if (orders_.Size() != 0)
+    throw std::logic_error("Only an empty book can be restored into.");
+
+  auto bestBid = std::numeric_limits<Price>::min();
+  auto bestAsk = std::numeric_limits<Price>::max();
+  for (const auto &record : records) {
+    // Anything past the last enumerator would be misrouted by DispatchSide
+    // and the per-type paths, so it's as much a bad record as a crossed one
+    if (record.side_ > static_cast<std::uint8_t>(Side::Sell) ||
+        record.orderType_ > static_cast<std::uint8_t>(OrderType::FillOrKill) ||
+        record.selfTradePrevention_ >
+            static_cast<std::uint8_t>(SelfTradePrevention::DecrementBoth))
+      throw std::logic_error(std::format(
+          "Order ({}) has a side, type or self-trade mode out of range.",
+          record.orderId_));
+
+    const auto type = static_cast<OrderType>(record.orderType_);
+    if (type == OrderType::Market || type == OrderType::FillAndKill ||
+        type == OrderType::FillOrKill || record.remainingQuantity_ == 0 ||
+        record.remainingQuantity_ > record.initialQuantity_ ||
+        record.price_ % tickSize_ != 0)
+      throw std::logic_error(std::format(
+          "Order ({}) cannot be resting in a book.", record.orderId_));
+
+    if (static_cast<Side>(record.side_) == Side::Buy)
+      bestBid = std::max(bestBid, record.price_);
+    else
+      bestAsk = std::min(bestAsk, record.price_);
+  }
+  // In the call phase orders rest wherever they were sent, crossed or not
+  if (!inAuction && bestBid >= bestAsk)
+    throw std::logic_error("A checkpoint cannot have crossed bids and asks.");
+
+  pool_.Reserve(records.size());
+  orders_.Reserve(records.size());
+
+  // Ids are spread across the whole index, so nearly every insert would be a
+  // cache miss; fetching a few records ahead keeps several in flight at once
+  constexpr std::size_t PrefetchDistance = 16;
+
+  std::vector<OrderHandle> handles;
+  handles.reserve(records.size());
+  for (std::size_t next = 0; next < records.size(); ++next) {
+    const auto &record = records[next];
+    if (next + PrefetchDistance < records.size())
+      orders_.Prefetch(records[next + PrefetchDistance].orderId_);
+
+    const auto handle = pool_.Allocate(record.ToOrder());
+    if (!orders_.Insert(record.orderId_, handle)) {
+      pool_.Release(handle);
+      for (std::size_t index = 0; index < handles.size(); ++index)
+        pool_.Release(orders_.Erase(records[index].orderId_));
+      throw std::logic_error(std::format(
+          "Order ({}) appears twice in the checkpoint.", record.orderId_));
+    }
+    handles.push_back(handle);
+  }
+
+  for (const auto handle : handles) {
+    const auto &order = pool_.Get(handle);
+    DispatchSide(order.GetSide(), [&](auto side) {
+      auto &ladder = Ladder<decltype(side)::value>();
+      ladder.PushBack(pool_, handle);
+      ladder.UpdateLevelData(order.GetPrice(), order.GetRemainingQuantity(),
+                             LevelData::Action::Add);
+    });
+
+    if (order.HasExpiry())
+      expiries_.Insert(handle, order.GetExpiry());
+  }
+
+  auction_ = inAuction;
+
+  // No deltas for the load itself; the skipped sequence number tells a feed
+  // consumer to resync from GetOrderInfos()
+  ++levelSequence_;
+
+  ScheduleExpiry(NextExpiryInternal());
+
+  PublishSnapshot();
+}
+
+void Orderbook::Restore(const BookCheckpoint &checkpoint) {
+  Restore(checkpoint.records_, checkpoint.inAuction_);
 }
 
 std::size_t Orderbook::Size() const {
-  std::scoped_lock ordersLock{ordersMutex_};
-  return orders_.size();
+  auto ordersLock = LockOrders();
+  return orders_.Size();
+}
+
+// Each ladder caches its touch, so neither of these walks anything
+std::optional<TouchLevel> Orderbook::GetBestBid() const {
+  auto ordersLock = LockOrders();
+  return bids_.Touch();
+}
+
+std::optional<TouchLevel> Orderbook::GetBestAsk() const {
+  auto ordersLock = LockOrders();
+  return asks_.Touch();
+}
+
+// Both sides under one lock, so the bid and ask are from the same moment
+TopOfBook Orderbook::GetTopOfBook() const {
+  auto ordersLock = LockOrders();
+  return TopOfBook{bids_.Touch(), asks_.Touch()};
 }
 
 /**
- * The GetOrderInfos() method iterates through all price levels in both
- * the bids and asks sides, accumulating the total quantity at each price.
+ * The GetOrderInfos() method reports the total quantity at each price level
+ * on both the bids and asks sides. The totals are kept up to date by
+ * UpdateLevelData, so this is one read per level rather than a sum over every
+ * order in the book.
  */
 OrderbookLevelInfos Orderbook::GetOrderInfos() const {
+  return GetOrderInfos(std::numeric_limits<std::size_t>::max());
+}
+
+OrderbookLevelInfos Orderbook::GetOrderInfos(std::size_t depth) const {
+  auto ordersLock = LockOrders();
+
   LevelInfos bidInfos, askInfos;
-  bidInfos.reserve(orders_.size());
-  askInfos.reserve(orders_.size());
-
-  auto CreateLevelInfos = [](Price price, const OrderPointers &orders) {
-    return LevelInfo{
-        price,
-        std::accumulate(orders.begin(), orders.end(), (Quantity)0,
-                        [](Quantity runningSum, const OrderPointer &order) {
-                          return runningSum + order->GetRemainingQuantity();
-                        })};
+  bidInfos.reserve(std::min(depth, bids_.Size()));
+  askInfos.reserve(std::min(depth, asks_.Size()));
+
+  auto CollectInto = [depth](LevelInfos &infos) {
+    return [&infos, depth](Price price, const LevelData &level) {
+      if (infos.size() == depth)
+        return false;
+      infos.push_back(LevelInfo{price, level.quantity_});
+      return true;
+    };
   };
 
-  // for (const std::pair<const Price, OrderPointers>& pair : bids_) {
-  //     const Price& price = pair.first;
-  //     OrderPointers& orders = pair.second;
-  //     // ...
-  // }
-  for (const auto &[price, orders] : bids_)
-    bidInfos.push_back(CreateLevelInfos(price, orders));
+  bids_.ForEachLevel(CollectInto(bidInfos));
+  asks_.ForEachLevel(CollectInto(askInfos));
 
-  for (const auto &[price, orders] : asks_)
-    askInfos.push_back(CreateLevelInfos(price, orders));
+  return OrderbookLevelInfos{std::move(bidInfos), std::move(askInfos),
+                             levelSequence_};
+}
+
+BookSnapshot Orderbook::ReadSnapshot() const { return snapshot_.Load(); }
+
+InstrumentationSnapshot Orderbook::GetInstrumentation() const {
+#ifdef ORDERBOOK_ENABLE_INSTRUMENTATION
+  return instrumentation_.Snapshot();
+#else
+  return {};
+#endif
+}
 
-  return OrderbookLevelInfos{bidInfos, askInfos};
+bool Orderbook::TryPollLevelUpdate(LevelUpdate &update) {
+  return levelUpdates_ && levelUpdates_->TryPop(update);
 }
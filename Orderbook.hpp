@@ -1,60 +1,137 @@
+#pragma once
+
+#include "Auction.hpp"
+#include "BookSnapshot.hpp"
+#include "CheckpointRecord.hpp"
+#include "ExpiryIndex.hpp"
+#include "Fill.hpp"
+#include "Instrumentation.hpp"
+#include "LevelUpdate.hpp"
 #include "Order.hpp"
+#include "OrderCommand.hpp"
+#include "OrderIndex.hpp"
 #include "OrderModify.hpp"
+#include "OrderPool.hpp"
+#include "OrderbookConfig.hpp"
 #include "OrderbookLevelInfos.hpp"
+#include "PriceLadder.hpp"
+#include "Seqlock.hpp"
+#include "SessionScheduler.hpp"
+#include "SideTraits.hpp"
+#include "SpscRing.hpp"
 #include "Trade.hpp"
+#include "TradeSink.hpp"
 #include "Usings.hpp"
-#include <condition_variable>
-#include <map>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <mutex>
-#include <unordered_map>
+#include <span>
+#include <thread>
+#include <vector>
 class Orderbook {
 private:
-  struct OrderEntry {
-    OrderPointer order_{nullptr};
-    OrderPointers::iterator location_;
-  };
-
-  struct LevelData {
-    Quantity quantity_{};
-    Quantity count_{};
-
-    enum class Action {
-      Add,
-      Remove,
-      Match,
-    };
-  };
-
-  std::unordered_map<Price, LevelData> data_;
-  // When you iterate over a std::map, it always yields std::pair<const Key,
-  // Value> elements.
-  std::map<Price, OrderPointers, std::greater<Price>>
-      bids_; // descending -> highest to lowest
-  std::map<Price, OrderPointers, std::less<Price>>
-      asks_; // ascending -> lowest to highest
-  std::unordered_map<OrderId, OrderEntry> orders_;
+  // Each side is a PriceLadder: array slots for prices near the touch, and a
+  // std::map for anything outside the configured band.
+  PriceLadder<SideTraits<Side::Buy>::Compare> bids_;  // highest to lowest
+  PriceLadder<SideTraits<Side::Sell>::Compare> asks_; // lowest to highest
+  // The order itself lives in pool_, and its position in the level FIFO is
+  // the intrusive link in the pool node, so the handle is all we need.
+  OrderIndex orders_;
+  OrderPool pool_;
+  ExpiryIndex expiries_;
+  Price tickSize_;
+  // In the call phase orders rest without matching, until Uncross
+  bool auction_{false};
+  // Expiry handed to GoodForDay orders, rolled forward by ExpireOrders once
+  // the session is over
+  ExpiryTime sessionClose_;
+  std::chrono::minutes sessionCloseTime_;
+  std::size_t expiryChunk_;
+  ThreadingMode threadingMode_;
+  JournalWriter *journal_;
+  // Market-by-price deltas, produced under the book's lock and drained by a
+  // single consumer. Null when the feed is off.
+  std::unique_ptr<SpscRing<LevelUpdate>> levelUpdates_;
+  std::uint64_t levelSequence_{};
+  // Top of book for readers that mustn't take ordersMutex_, republished
+  // after every command when snapshotDepth_ is non-zero
+  Seqlock<BookSnapshot> snapshot_;
+  std::size_t snapshotDepth_;
   mutable std::mutex ordersMutex_;
-  std::thread ordersPruneThread_;
-  std::condition_variable shutdownConditionVariable_;
-  std::atomic<bool> shutdown_{false};
+  // Locked books only. Keeps time on its own thread and mutex, and when the
+  // next expiry is due calls ExpireDue, which comes in through the public
+  // API like any other command. Nothing but the lock holder touches the book.
+  std::unique_ptr<SessionScheduler> scheduler_;
+  std::size_t schedulerTarget_{};
+  // The deadline we last gave scheduler_, guarded by ordersMutex_, so an add
+  // only talks to the scheduler when it expires sooner than that
+  ExpiryTime scheduledExpiry_{ExpiryTime::max()};
+#ifdef ORDERBOOK_ENABLE_INSTRUMENTATION
+  // Written by whoever holds the book, LockOrders included, hence mutable
+  mutable Instrumentation instrumentation_;
+#endif
+
+  std::unique_lock<std::mutex> LockOrders() const;
+  void ExpireDue();
+  void ScheduleExpiry(ExpiryTime expiry);
+  ExpiryTime NextExpiryInternal() const;
 
-  void PruneGoodForDayOrders();
+  // The bodies of the public commands, for callers that already hold the lock
+  void ApplyAdd(const Order &order, TradeSink onTrade);
+  void ApplyCancel(OrderId orderId);
+  bool ApplyModify(const OrderModify &order, TradeSink onTrade);
+  std::size_t ApplyExpire(std::chrono::system_clock::time_point now,
+                          std::size_t limit);
+  void ApplySessionClose(ExpiryTime close);
+  void ApplyBeginAuction();
+  AuctionResult ApplyUncross(TradeSink onTrade);
 
-  void CancelOrders(OrderIds orderIds);
   void CancelOrderInternal(OrderId orderId);
+  void LinkOrder(OrderHandle handle);
+  void UnlinkOrder(OrderHandle handle);
+  void RemoveOrder(OrderHandle handle);
 
-  void OnOrderCancelled(OrderPointer order);
-  void OnOrderAdded(OrderPointer order);
+  void OnOrderCancelled(const Order &order);
+  void OnOrderAdded(const Order &order);
+  template <Side S>
   void OnOrderMatched(Price price, Quantity quantity, bool isFullyFilled);
+  template <Side S>
   void UpdateLevelData(Price price, Quantity quantity,
                        LevelData::Action action);
+  void UpdateLevelData(Side side, Price price, Quantity quantity,
+                       LevelData::Action action);
 
-  bool CanFullyFill(Side side, Price price, Quantity) const;
-  bool CanMatch(Side side, Price price) const;
-  Trades MatchOrders();
+  // bids_ or asks_, picked at compile time
+  template <Side S> auto &Ladder();
+  template <Side S> const auto &Ladder() const;
+
+  template <Side S> bool CanFullyFill(Price price, Quantity quantity) const;
+  template <Side S>
+  bool CanFullyFillWithoutSelfTrade(const Order &incoming) const;
+  template <Side S> bool CanMatch(Price price) const;
+  bool OnTick(const Order &order) const;
+  // This side's levels that cross the other side's touch, best first
+  template <Side S> LevelInfos CrossedLevels() const;
+  AuctionResult IndicativeUncrossInternal() const;
+  // The add path for one side and order type; ApplyAdd picks which
+  template <Side S, OrderType Type> void AddAs(Order order, TradeSink onTrade);
+  // Market, FillAndKill and FillOrKill orders trade here and never rest
+  template <Side S, OrderType Type>
+  void Sweep(Order &incoming, TradeSink onTrade);
+  // `aggressor` is the order that was just added or moved; if anyone, it's
+  // the one crossing the book
+  void MatchOrders(OrderHandle aggressor, TradeSink onTrade);
+  bool PreventSelfTrade(OrderHandle aggressor, OrderHandle resting);
+  // Trades the two orders against each other for as much as they both have,
+  // reporting each side at the given price
+  void Execute(OrderHandle bidHandle, OrderHandle askHandle, Price bidPrice,
+               Price askPrice, TradeSink onTrade);
+  void PublishSnapshot();
 
 public:
   Orderbook();
+  explicit Orderbook(const OrderbookConfig &config);
   Orderbook(const Orderbook &) = delete;
   void operator=(const Orderbook &) = delete;
   Orderbook(Orderbook &&) = delete;
@@ -62,9 +139,96 @@ public:
   ~Orderbook();
 
   Trades AddOrder(OrderPointer order);
+  // The book copies the order into its own storage either way, so callers
+  // holding plain values don't need to allocate a shared_ptr first
+  Trades AddOrder(const Order &order);
+  // Same as above, but every trade goes straight to `onTrade` as it happens
+  // instead of being collected into a vector
+  void AddOrder(const Order &order, TradeSink onTrade);
+  // Into a buffer the caller keeps between calls. `fills` is cleared first,
+  // so after a warm-up nothing here allocates.
+  void AddOrder(const Order &order, Fills &fills);
   void CancelOrder(OrderId orderId);
   Trades ModifyOrder(OrderModify order);
+  void ModifyOrder(OrderModify order, TradeSink onTrade);
+  void ModifyOrder(OrderModify order, Fills &fills);
+
+  // Batches take the lock once for the whole span and apply it in order,
+  // appending every trade to `trades`
+  void AddOrders(std::span<const OrderPointer> orders, Trades &trades);
+  void ApplyBatch(std::span<const OrderCommand> commands, Trades &trades);
+  void ApplyBatch(std::span<const OrderCommand> commands, TradeSink onTrade);
+  // Clears `fills` once, then collects the fills of the whole batch
+  void ApplyBatch(std::span<const OrderCommand> commands, Fills &fills);
+
+  // The earliest time at which ExpireOrders has something to do: the next
+  // GoodTillDate expiry or the session close, whichever comes first
+  ExpiryTime NextExpiry() const;
+  // Cancels orders whose expiry is at or before `now`, at most one
+  // OrderbookConfig::expiryChunk_ worth per call, and returns how many went.
+  // Locked books do this on their own from a background thread; single-writer
+  // books leave it to their owner.
+  std::size_t ExpireOrders(std::chrono::system_clock::time_point now);
+  // The same, but at most `limit` orders whatever expiryChunk_ is. For
+  // ReplayJournal, which expires exactly as many as each recorded pass did.
+  std::size_t ExpireOrders(std::chrono::system_clock::time_point now,
+                           std::size_t limit);
+  // Moves the session close, the expiry GoodForDay orders get from here on,
+  // until ExpireOrders reaches it and rolls it forward as usual. Resting
+  // orders keep theirs. ReplayJournal uses this to give orders the closes
+  // they had the first time; a live book works its own out from
+  // OrderbookConfig::sessionClose_.
+  void SetSessionClose(ExpiryTime close);
+
+  // Starts a call phase (say, ahead of the open): from here on orders rest
+  // without matching, even when they cross. Market, FillAndKill and
+  // FillOrKill orders have nothing to trade against yet and are ignored.
+  void BeginAuction();
+  // Ends the call phase. Everything that crosses trades at the one price
+  // that clears the most quantity (see FindClearingPrice in Auction.hpp),
+  // in price-time priority, and the book goes back to continuous matching.
+  AuctionResult Uncross(TradeSink onTrade);
+  bool InAuction() const;
+  // What Uncross would do right now, without doing it
+  AuctionResult GetIndicativeUncross() const;
+
+  // Every resting order, bids then asks, best level first and in time
+  // priority within each level, and whether the book is in its call phase.
+  // Write it out with WriteCheckpoint (Checkpoint.hpp).
+  BookCheckpoint Checkpoint() const;
+  // Loads a checkpoint into an empty book without matching it, leaving the
+  // book exactly as it was when the checkpoint was taken, call phase
+  // included. Throws std::logic_error (and leaves the book empty) if the book
+  // isn't empty or the records aren't a book: a duplicated order, one that
+  // couldn't have been resting, or crossed bids and asks outside an auction.
+  void Restore(std::span<const CheckpointRecord> records,
+               bool inAuction = false);
+  void Restore(const BookCheckpoint &checkpoint);
 
   std::size_t Size() const;
+  // The touch on each side, read from the ladder's cached best level: no
+  // walk, no allocation. Empty when that side has nothing resting.
+  std::optional<TouchLevel> GetBestBid() const;
+  std::optional<TouchLevel> GetBestAsk() const;
+  TopOfBook GetTopOfBook() const;
   OrderbookLevelInfos GetOrderInfos() const;
+  // Only the best `depth` levels of each side
+  OrderbookLevelInfos GetOrderInfos(std::size_t depth) const;
+
+  // The next market-by-price delta, if there is one. Only one thread may
+  // poll, and only when OrderbookConfig::levelUpdateCapacity_ was set. If the
+  // poller falls behind, updates are dropped rather than stalling matching;
+  // watch for gaps in sequence_ and resync from GetOrderInfos().
+  bool TryPollLevelUpdate(LevelUpdate &update);
+
+  // Best bid/ask, their sizes, the top OrderbookConfig::snapshotDepth_ levels
+  // and the order count, as of the last command. Never takes the lock and
+  // never holds up matching, so any number of threads may call it. Empty
+  // unless snapshotDepth_ was set.
+  BookSnapshot ReadSnapshot() const;
+
+  // Per-stage latency histograms and counters, readable from any thread
+  // while the book runs. All zeros unless the build defines
+  // ORDERBOOK_ENABLE_INSTRUMENTATION.
+  InstrumentationSnapshot GetInstrumentation() const;
 };
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Usings.hpp"
+#include <chrono>
+#include <cstddef>
+#include <optional>
+
+class JournalWriter;
+
+enum class ThreadingMode {
+  // Every public method takes the book's mutex, so any thread may call in,
+  // and a background thread expires GoodForDay orders at the session close.
+  Locked,
+  // The book is owned by exactly one thread (see Sequencer.hpp). Nothing is
+  // locked and no background thread is started.
+  SingleWriter,
+};
+
+// Knobs for sizing an Orderbook up front. The defaults work for any
+// instrument; tuning them just moves more of the flow onto the fast paths.
+struct OrderbookConfig {
+  // How many ticks each side's price ladder covers. Levels inside the band are
+  // array slots, anything outside falls back to a std::map.
+  std::size_t priceBandLevels_{1024};
+  // Lowest price inside the band. When unset, each side centres its band on
+  // the first price it sees and re-centres whenever the band drains.
+  std::optional<Price> priceBandBase_{};
+  // Every price must be a multiple of this; orders off the grid are ignored,
+  // like duplicates. Each band slot is one tick, so a coarse tick stretches
+  // the band over a wider range of prices.
+  Price tickSize_{1};
+  // How many orders the book expects to hold at its peak. The order pool,
+  // the order index and the expiry links are all sized for this many in the
+  // constructor, so they never grow (or rehash) before the book gets there.
+  std::size_t expectedOrders_{0};
+  // How many price levels per side the overflow map should have room for
+  // before it goes to the allocator. Only levels outside the band use it.
+  std::size_t expectedLevels_{0};
+  // How many distinct expiry times the book expects to have resting at once:
+  // the session close, plus one per GoodTillDate deadline. The expiry index
+  // has room for this many before it goes to the allocator.
+  std::size_t expectedExpiries_{0};
+  // Put the book's big arrays on huge pages, pre-faulted in the constructor
+  // (see HugePageResource.hpp)
+  bool hugePages_{false};
+  ThreadingMode threadingMode_{ThreadingMode::Locked};
+  // Local time of day at which the session ends and GoodForDay orders expire
+  std::chrono::minutes sessionClose_{std::chrono::hours(16)};
+  // How many orders one expiry pass cancels before letting matching back in
+  std::size_t expiryChunk_{1024};
+  // When set, every command the book accepts is appended here before it is
+  // applied (see Journal.hpp). The writer must outlive the book.
+  JournalWriter *journal_{nullptr};
+  // Room for this many LevelUpdates between polls (see TryPollLevelUpdate).
+  // Zero turns the delta feed off.
+  std::size_t levelUpdateCapacity_{0};
+  // How many levels per side ReadSnapshot() reports, up to
+  // BookSnapshot::MaxDepth. Zero means no snapshot is kept.
+  std::size_t snapshotDepth_{0};
+};
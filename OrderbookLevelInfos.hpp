@@ -1,10 +1,13 @@
 #pragma once
 
 #include "LevelInfos.hpp"
+#include <cstdint>
+#include <utility>
 class OrderbookLevelInfos {
 public:
-  OrderbookLevelInfos(const LevelInfos &bids, const LevelInfos &asks)
-      : bids_{bids}, asks_{asks} {};
+  OrderbookLevelInfos(LevelInfos bids, LevelInfos asks,
+                      std::uint64_t sequence = 0)
+      : bids_{std::move(bids)}, asks_{std::move(asks)}, sequence_{sequence} {};
 
   // Return Type == `const LevelInfos &`
   // LevelInfos = The Type of Data being Returned
@@ -17,9 +20,12 @@ public:
   // promises this function will not modify any member variables of the class
   const LevelInfos &GetBids() const { return bids_; }
   const LevelInfos &GetAsks() const { return asks_; }
+  // The sequence_ of the last LevelUpdate this snapshot already includes
+  std::uint64_t GetSequence() const { return sequence_; }
 
 private:
   LevelInfos bids_;
   LevelInfos asks_;
+  std::uint64_t sequence_;
 };
 
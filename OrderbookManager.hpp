@@ -0,0 +1,255 @@
+#pragma once
+
+#include "OrderCommand.hpp"
+#include "Orderbook.hpp"
+#include "Sequencer.hpp"
+#include "SessionScheduler.hpp"
+#include "SpscRing.hpp"
+#include "Usings.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+struct OrderbookManagerConfig {
+  // How many matching threads to run. Symbols are dealt out to them
+  // round-robin, in the order they were given to the manager.
+  std::size_t workers_{1};
+  // How many threads will call TrySubmit; each gets its own ring per worker
+  std::size_t producers_{1};
+  std::size_t ringCapacity_{4096};
+  // Pin worker i to core firstCore_ + i (wrapping around). Linux only; this
+  // is a no-op elsewhere.
+  bool pinWorkers_{false};
+  std::size_t firstCore_{0};
+  // Used for every book. The threading mode is always SingleWriter.
+  OrderbookConfig book_{};
+};
+
+/**
+ * Many instruments, a few threads.
+ *
+ * Every symbol's book belongs to exactly one worker, and only that worker ever
+ * touches it, so every book runs in ThreadingMode::SingleWriter: no locks, no
+ * schedulers. Producers push OrderCommands tagged with a symbol_, and each
+ * worker drains its rings the same way a Sequencer does.
+ *
+ * Expiry for all books is driven by one shared SessionScheduler. Each worker
+ * is a single target whose deadline is the earliest NextExpiry() of any of
+ * its books. When it comes due, the scheduler flags the worker and the worker
+ * runs the expiry pass itself, between commands.
+ */
+class OrderbookManager {
+private:
+  static constexpr std::size_t DrainBatch = 256;
+
+  struct Worker {
+    std::vector<std::unique_ptr<SpscRing<OrderCommand>>> ingress_;
+    SpscRing<ExecutionReport> outbound_;
+    std::unordered_map<SymbolId, std::unique_ptr<Orderbook>> books_;
+    std::size_t schedulerTarget_{};
+    // The deadline we last gave the scheduler
+    ExpiryTime published_{ExpiryTime::max()};
+    std::atomic<bool> expiryDue_{false};
+    std::thread thread_;
+
+    explicit Worker(std::size_t capacity) : outbound_{capacity} {}
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  // Written once in the constructor and only read afterwards, so producers
+  // can route without synchronising
+  std::unordered_map<SymbolId, std::size_t> routes_;
+  SessionScheduler scheduler_;
+  std::atomic<bool> stop_{false};
+
+  static OrderbookConfig SingleWriter(OrderbookConfig config) {
+    config.threadingMode_ = ThreadingMode::SingleWriter;
+    return config;
+  }
+
+  static void PinToCore([[maybe_unused]] std::thread &thread,
+                        [[maybe_unused]] std::size_t core) {
+#ifdef __linux__
+    const auto cores = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core % cores, &cpus);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+#endif
+  }
+
+  static void Publish(Worker &worker, const ExecutionReport &report) {
+    while (!worker.outbound_.TryPush(report))
+      std::this_thread::yield();
+  }
+
+  void Reschedule(Worker &worker, ExpiryTime deadline) {
+    worker.published_ = deadline;
+    scheduler_.Reschedule(worker.schedulerTarget_, deadline);
+  }
+
+  void Apply(Worker &worker, const OrderCommand &command) {
+    const auto book = worker.books_.find(command.symbol_);
+    if (book != worker.books_.end()) {
+      auto &orderbook = *book->second;
+      ApplyCommand(orderbook, command, [&worker, &command](const Trade &trade) {
+        Publish(worker, ExecutionReport{ReportType::Trade, command.tag_,
+                                        trade.GetBidTrade(),
+                                        trade.GetAskTrade(), command.symbol_});
+      });
+
+      // Only an order that expires sooner than anything else on this worker
+      // needs the scheduler to hear about it
+      const auto next = orderbook.NextExpiry();
+      if (next < worker.published_)
+        Reschedule(worker, next);
+    }
+
+    Publish(worker, ExecutionReport{ReportType::Completed, command.tag_, {}, {},
+                                    command.symbol_});
+  }
+
+  // One chunk per due book, then hand the next deadline back to the
+  // scheduler. If a book still has a backlog that deadline is already due,
+  // and the scheduler posts us straight back after we've drained some more.
+  void ExpireDue(Worker &worker) {
+    const auto now = std::chrono::system_clock::now();
+    auto next = ExpiryTime::max();
+
+    for (auto &[symbol, orderbook] : worker.books_) {
+      if (orderbook->NextExpiry() <= now)
+        orderbook->ExpireOrders(now);
+      next = std::min(next, orderbook->NextExpiry());
+    }
+
+    Reschedule(worker, next);
+  }
+
+  std::size_t Drain(Worker &worker) {
+    std::size_t applied{};
+    OrderCommand command;
+
+    for (auto &ring : worker.ingress_) {
+      for (std::size_t taken = 0; taken < DrainBatch && ring->TryPop(command);
+           ++taken, ++applied)
+        Apply(worker, command);
+    }
+
+    return applied;
+  }
+
+  void Run(Worker &worker) {
+    while (!stop_.load(std::memory_order_acquire)) {
+      const auto applied = Drain(worker);
+
+      if (worker.expiryDue_.load(std::memory_order_relaxed) &&
+          worker.expiryDue_.exchange(false, std::memory_order_acquire))
+        ExpireDue(worker);
+
+      if (applied == 0)
+        std::this_thread::yield();
+    }
+
+    while (Drain(worker) != 0) {
+    }
+  }
+
+public:
+  OrderbookManager(const OrderbookManagerConfig &config,
+                   std::span<const SymbolId> symbols) {
+    const auto workers = std::max<std::size_t>(config.workers_, 1);
+    const auto bookConfig = SingleWriter(config.book_);
+
+    workers_.reserve(workers);
+    for (std::size_t index = 0; index < workers; ++index) {
+      auto worker = std::make_unique<Worker>(config.ringCapacity_);
+      worker->ingress_.reserve(config.producers_);
+      for (std::size_t producer = 0; producer < config.producers_; ++producer)
+        worker->ingress_.push_back(
+            std::make_unique<SpscRing<OrderCommand>>(config.ringCapacity_));
+
+      worker->schedulerTarget_ =
+          scheduler_.Register([raw = worker.get()] {
+            raw->expiryDue_.store(true, std::memory_order_release);
+          });
+      workers_.push_back(std::move(worker));
+    }
+
+    for (std::size_t index = 0; index < symbols.size(); ++index) {
+      const auto [route, inserted] =
+          routes_.emplace(symbols[index], index % workers);
+      if (inserted)
+        workers_[route->second]->books_.emplace(
+            symbols[index], std::make_unique<Orderbook>(bookConfig));
+    }
+
+    for (auto &worker : workers_) {
+      auto next = ExpiryTime::max();
+      for (const auto &[symbol, orderbook] : worker->books_)
+        next = std::min(next, orderbook->NextExpiry());
+      Reschedule(*worker, next);
+    }
+
+    scheduler_.Start();
+
+    for (std::size_t index = 0; index < workers_.size(); ++index) {
+      auto &worker = *workers_[index];
+      worker.thread_ = std::thread{[this, &worker] { Run(worker); }};
+      if (config.pinWorkers_)
+        PinToCore(worker.thread_, config.firstCore_ + index);
+    }
+  }
+
+  OrderbookManager(const OrderbookManager &) = delete;
+  void operator=(const OrderbookManager &) = delete;
+  OrderbookManager(OrderbookManager &&) = delete;
+  void operator=(OrderbookManager &&) = delete;
+
+  ~OrderbookManager() { Stop(); }
+
+  std::size_t Workers() const { return workers_.size(); }
+
+  // Throws std::out_of_range for a symbol the manager wasn't built with
+  std::size_t WorkerFor(SymbolId symbol) const { return routes_.at(symbol); }
+
+  // Must only be called from the thread that owns `producer`. Returns false if
+  // that producer's ring to the symbol's worker is full.
+  bool TrySubmit(std::size_t producer, const OrderCommand &command) {
+    return workers_[WorkerFor(command.symbol_)]->ingress_[producer]->TryPush(
+        command);
+  }
+
+  // Each worker has its own outbound ring, with one consumer per ring
+  bool TryPoll(std::size_t worker, ExecutionReport &report) {
+    return workers_[worker]->outbound_.TryPop(report);
+  }
+
+  /**
+   * Drains everything that has been submitted and joins the workers. As with
+   * Sequencer::Stop, the consumers must keep polling until this returns.
+   */
+  void Stop() {
+    scheduler_.Stop();
+
+    stop_.store(true, std::memory_order_release);
+    for (auto &worker : workers_) {
+      if (worker->thread_.joinable())
+        worker->thread_.join();
+    }
+  }
+
+  // Books belong to their workers; only look at them after Stop()
+  const Orderbook &GetOrderbook(SymbolId symbol) const {
+    return *workers_[WorkerFor(symbol)]->books_.at(symbol);
+  }
+};
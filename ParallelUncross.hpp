@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Auction.hpp"
+#include "Orderbook.hpp"
+#include "Trade.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <span>
+#include <thread>
+#include <vector>
+
+/**
+ * Uncrosses many books at once, for an open across thousands of symbols.
+ *
+ * `threads` threads (the caller being one of them) take books off a shared
+ * counter one at a time, so a few deep books don't hold up the rest. Each
+ * book is still uncrossed under its own lock, and books never share state,
+ * so nothing else is synchronised. Results come back in the order of
+ * `books`.
+ *
+ * `onTrade(index, trade)` reports trades of books[index] on whichever thread
+ * uncrossed it: it is called concurrently for different books.
+ *
+ * Books must be Locked or otherwise not in use while this runs. For books
+ * owned by an OrderbookManager, send each symbol CommandType::Uncross
+ * instead; every worker then uncrosses its own books in parallel.
+ */
+template <typename OnTrade>
+std::vector<AuctionResult> UncrossInParallel(std::span<Orderbook *const> books,
+                                             std::size_t threads,
+                                             OnTrade &&onTrade) {
+  std::vector<AuctionResult> results(books.size());
+  std::atomic<std::size_t> next{0};
+
+  auto Work = [&] {
+    for (auto index = next.fetch_add(1, std::memory_order_relaxed);
+         index < books.size();
+         index = next.fetch_add(1, std::memory_order_relaxed))
+      results[index] =
+          books[index]->Uncross([&onTrade, index](const Trade &trade) {
+            onTrade(index, trade);
+          });
+  };
+
+  std::vector<std::jthread> helpers;
+  const auto helperCount = std::min(std::max<std::size_t>(threads, 1),
+                                    std::max<std::size_t>(books.size(), 1)) -
+                           1;
+  helpers.reserve(helperCount);
+  for (std::size_t helper = 0; helper < helperCount; ++helper)
+    helpers.emplace_back(Work);
+  Work();
+
+  // jthread joins on destruction, and every result has to be in by the time
+  // we hand them back
+  helpers.clear();
+  return results;
+}
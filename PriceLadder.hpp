@@ -0,0 +1,410 @@
+#pragma once
+
+#include "LevelKernels.hpp"
+#include "TopOfBook.hpp"
+#include "OrderPool.hpp"
+#include "Usings.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Running totals for one price level, kept current by
+// Orderbook::UpdateLevelData as orders are added, cancelled and matched. This
+// is what lets snapshots and fill checks read a level without walking its
+// orders.
+struct LevelData {
+  Quantity quantity_{};
+  Quantity count_{};
+
+  enum class Action {
+    Add,
+    Remove,
+    Match,
+  };
+
+  // The totals don't always live in a LevelData (see PriceLadder), so the
+  // arithmetic works on the two fields wherever they are
+  static void Apply(Quantity &quantity, Quantity &count, Quantity delta,
+                    Action action) {
+    count += action == Action::Remove ? -1 : action == Action::Add ? 1 : 0;
+    if (action == Action::Remove || action == Action::Match)
+      quantity -= delta;
+    else
+      quantity += delta;
+  }
+};
+
+struct PriceLevel {
+  OrderQueue orders_;
+  LevelData data_;
+};
+
+// One side of the book.
+//
+// Almost all flow lands within a few hundred ticks of the touch, so instead of
+// a tree keyed by price we keep a contiguous array of levels covering a band
+// of prices. Slots are laid out in priority order: slot 0 is the best price the
+// band can hold (the highest bid, or the lowest ask), so "better" always means
+// "lower index" regardless of side.
+//
+// A bitmap of non-empty slots lets us find the next level after the touch
+// with a handful of countr_zero calls, and the best slot is cached so the
+// touch itself is O(1). Prices outside the band go into `overflow_`, the same
+// std::map the book used before.
+//
+// The band is stored as a structure of arrays: the queues in one vector, and
+// each level's total quantity and order count in two more. Anything that walks
+// depth (fill checks, snapshots) only reads the totals, so it streams through
+// 4 bytes per level instead of dragging every queue into cache with it.
+//
+// Each slot is one tick. Prices are expected to be on the tick grid, which
+// the book checks on the way in.
+template <typename Compare> class PriceLadder {
+private:
+  static constexpr bool Descending =
+      std::is_same_v<Compare, std::greater<Price>>;
+  static constexpr std::size_t WordBits = 64;
+
+  std::pmr::vector<OrderQueue> queues_;
+  std::pmr::vector<Quantity> quantities_;
+  std::pmr::vector<Quantity> counts_;
+  std::pmr::vector<std::uint64_t> occupied_;
+  // Overflow levels come and go with the flow, so their map nodes come from
+  // a pool that keeps what it's given back instead of freeing it
+  std::pmr::unsynchronized_pool_resource overflowNodes_;
+  std::pmr::map<Price, PriceLevel, Compare> overflow_;
+  std::int64_t base_{};
+  std::int64_t tick_{1};
+  std::size_t best_{};
+  std::size_t activeLevels_{};
+  bool anchored_{false};
+  bool fixedBase_{false};
+
+  std::size_t BandSize() const { return queues_.size(); }
+
+  // Whether a price beats everything the band can hold
+  bool AheadOfBand(Price price) const {
+    return !anchored_ || BandSize() == 0 || Compare{}(price, ToPrice(0));
+  }
+
+  bool InBand(Price price) const {
+    const auto offset = static_cast<std::int64_t>(price) - base_;
+    return anchored_ && offset >= 0 &&
+           offset < static_cast<std::int64_t>(BandSize()) * tick_;
+  }
+
+  std::size_t ToIndex(Price price) const {
+    auto offset = static_cast<std::size_t>(price - base_);
+    // Nearly every book trades in whole ticks of 1, and that check is a lot
+    // cheaper than the division
+    if (tick_ != 1)
+      offset /= static_cast<std::size_t>(tick_);
+    return Descending ? BandSize() - 1 - offset : offset;
+  }
+
+  Price ToPrice(std::size_t index) const {
+    const auto offset = Descending ? BandSize() - 1 - index : index;
+    return static_cast<Price>(base_ + static_cast<std::int64_t>(offset) * tick_);
+  }
+
+  // Largest multiple of the tick at or below `price`
+  std::int64_t OnGrid(std::int64_t price) const {
+    const auto remainder = price % tick_;
+    return price - (remainder < 0 ? remainder + tick_ : remainder);
+  }
+
+  void Mark(std::size_t index) {
+    occupied_[index / WordBits] |= std::uint64_t{1} << (index % WordBits);
+    ++activeLevels_;
+    if (index < best_)
+      best_ = index;
+  }
+
+  void Unmark(std::size_t index) {
+    occupied_[index / WordBits] &= ~(std::uint64_t{1} << (index % WordBits));
+    --activeLevels_;
+    if (index == best_)
+      best_ = NextOccupied(index + 1);
+  }
+
+  // First non-empty slot at or after `from`, or BandSize() if there is none
+  std::size_t NextOccupied(std::size_t from) const {
+    if (from >= BandSize())
+      return BandSize();
+
+    auto word = from / WordBits;
+    auto bits = occupied_[word] & (~std::uint64_t{0} << (from % WordBits));
+
+    while (bits == 0) {
+      if (++word == occupied_.size())
+        return BandSize();
+      bits = occupied_[word];
+    }
+
+    return word * WordBits + std::countr_zero(bits);
+  }
+
+  // Last non-empty slot, or BandSize() if there is none
+  std::size_t LastOccupied() const {
+    for (auto word = occupied_.size(); word-- > 0;) {
+      if (occupied_[word] != 0)
+        return word * WordBits + (WordBits - 1) -
+               std::countl_zero(occupied_[word]);
+    }
+    return BandSize();
+  }
+
+  /**
+   * Centre the band on `price`. This only ever happens while the band is
+   * empty, so the only levels we may need to carry over are overflow levels
+   * that now fall inside the new band. Those are one contiguous run of the
+   * map, so this is a lookup plus whatever moves, however big the overflow.
+   */
+  void Anchor(Price price) {
+    const auto half = static_cast<std::int64_t>(BandSize() / 2) * tick_;
+    const auto lowest = OnGrid(
+        static_cast<std::int64_t>(std::numeric_limits<Price>::min()) + tick_ -
+        1);
+    const auto highest = OnGrid(
+        static_cast<std::int64_t>(std::numeric_limits<Price>::max()) -
+        (static_cast<std::int64_t>(BandSize()) - 1) * tick_);
+    base_ = std::clamp(static_cast<std::int64_t>(price) - half, lowest,
+                       std::max(lowest, highest));
+    anchored_ = true;
+
+    const auto low = static_cast<Price>(base_);
+    const auto high = static_cast<Price>(
+        base_ + (static_cast<std::int64_t>(BandSize()) - 1) * tick_);
+    const auto end = overflow_.upper_bound(Descending ? low : high);
+    for (auto level = overflow_.lower_bound(Descending ? high : low);
+         level != end;) {
+      const auto index = ToIndex(level->first);
+      queues_[index] = level->second.orders_;
+      quantities_[index] = level->second.data_.quantity_;
+      counts_[index] = level->second.data_.count_;
+      Mark(index);
+      level = overflow_.erase(level);
+    }
+  }
+
+  OrderQueue &QueueFor(Price price) {
+    // With no band at all there's nothing to anchor, and every level is
+    // overflow
+    if (BandSize() != 0 && !fixedBase_ && activeLevels_ == 0 && !InBand(price))
+      Anchor(price);
+
+    if (!InBand(price))
+      return overflow_[price].orders_;
+
+    const auto index = ToIndex(price);
+    if (queues_[index].Empty())
+      Mark(index);
+    return queues_[index];
+  }
+
+public:
+  explicit PriceLadder(
+      std::size_t bandLevels, std::optional<Price> basePrice = std::nullopt,
+      Price tick = 1,
+      std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+      : queues_(bandLevels, memory), quantities_(bandLevels, memory),
+        counts_(bandLevels, memory),
+        occupied_((bandLevels + WordBits - 1) / WordBits, memory),
+        overflowNodes_{memory}, overflow_{&overflowNodes_},
+        tick_{std::max<std::int64_t>(tick, 1)}, best_{bandLevels} {
+    if (basePrice.has_value()) {
+      // A fixed base has to be on the grid too, or no price would be
+      base_ = OnGrid(*basePrice);
+      anchored_ = true;
+      fixedBase_ = true;
+    }
+  }
+
+  PriceLadder(const PriceLadder &) = delete;
+  void operator=(const PriceLadder &) = delete;
+
+  // Builds `levels` overflow levels and drops them again, which leaves the
+  // node pool holding enough memory for that many. Only for an empty ladder.
+  void ReserveOverflow(std::size_t levels) {
+    for (std::size_t level = 0; level < levels; ++level)
+      overflow_.try_emplace(static_cast<Price>(level));
+    overflow_.clear();
+  }
+
+  bool Empty() const { return activeLevels_ == 0 && overflow_.empty(); }
+  std::size_t Size() const { return activeLevels_ + overflow_.size(); }
+
+  std::optional<Price> Best() const {
+    const bool hasBand = best_ != BandSize();
+    if (!overflow_.empty()) {
+      const auto overflowBest = overflow_.begin()->first;
+      if (!hasBand || Compare{}(overflowBest, ToPrice(best_)))
+        return overflowBest;
+    }
+    if (hasBand)
+      return ToPrice(best_);
+    return std::nullopt;
+  }
+
+  // The best level and its totals, straight from the cached touch
+  std::optional<TouchLevel> Touch() const {
+    const bool hasBand = best_ != BandSize();
+    if (!overflow_.empty()) {
+      const auto &[price, level] = *overflow_.begin();
+      if (!hasBand || Compare{}(price, ToPrice(best_)))
+        return TouchLevel{price, level.data_.quantity_, level.data_.count_};
+    }
+    if (hasBand)
+      return TouchLevel{ToPrice(best_), quantities_[best_], counts_[best_]};
+    return std::nullopt;
+  }
+
+  std::optional<Price> Worst() const {
+    const auto last = LastOccupied();
+    if (!overflow_.empty()) {
+      const auto overflowWorst = overflow_.rbegin()->first;
+      if (last == BandSize() || Compare{}(ToPrice(last), overflowWorst))
+        return overflowWorst;
+    }
+    if (last != BandSize())
+      return ToPrice(last);
+    return std::nullopt;
+  }
+
+  // The level must exist, i.e. the price came from Best()/Worst() or from a
+  // resting order
+  OrderHandle Front(Price price) const {
+    return InBand(price) ? queues_[ToIndex(price)].Front()
+                         : overflow_.at(price).orders_.Front();
+  }
+
+  LevelData Level(Price price) const {
+    if (!InBand(price))
+      return overflow_.at(price).data_;
+    const auto index = ToIndex(price);
+    return LevelData{quantities_[index], counts_[index]};
+  }
+
+  // Returns the level's new totals
+  LevelData UpdateLevelData(Price price, Quantity quantity,
+                            LevelData::Action action) {
+    if (!InBand(price)) {
+      auto &data = overflow_.at(price).data_;
+      LevelData::Apply(data.quantity_, data.count_, quantity, action);
+      return data;
+    }
+    const auto index = ToIndex(price);
+    LevelData::Apply(quantities_[index], counts_[index], quantity, action);
+    return LevelData{quantities_[index], counts_[index]};
+  }
+
+  void PushBack(OrderPool &pool, OrderHandle handle) {
+    QueueFor(pool.Get(handle).GetPrice()).PushBack(pool, handle);
+  }
+
+  // Unlinks the order from its level, dropping the level once it's empty.
+  // The level's totals have to be brought up to date before this, since an
+  // overflow level disappears along with its last order.
+  void Erase(OrderPool &pool, OrderHandle handle) {
+    const auto price = pool.Get(handle).GetPrice();
+
+    if (!InBand(price)) {
+      auto level = overflow_.find(price);
+      level->second.orders_.Erase(pool, handle);
+      if (level->second.orders_.Empty())
+        overflow_.erase(level);
+      return;
+    }
+
+    const auto index = ToIndex(price);
+    queues_[index].Erase(pool, handle);
+    if (queues_[index].Empty())
+      Unmark(index);
+  }
+
+  /**
+   * Whether there is at least `quantity` resting at `limit` or better.
+   *
+   * Empty band slots hold zero, so the band part doesn't need the bitmap at
+   * all: it's one FindCumulative over the contiguous run of quantities from
+   * the touch to the limit.
+   */
+  bool CanFill(Price limit, Quantity quantity) const {
+    std::uint64_t needed = quantity;
+    auto level = overflow_.begin();
+
+    for (; level != overflow_.end() && AheadOfBand(level->first); ++level) {
+      if (Compare{}(limit, level->first))
+        return false;
+      if (level->second.data_.quantity_ >= needed)
+        return true;
+      needed -= level->second.data_.quantity_;
+    }
+
+    if (best_ != BandSize()) {
+      if (Compare{}(limit, ToPrice(best_)))
+        return false;
+
+      // The limit is either inside the band, or behind all of it
+      const auto last = InBand(limit) ? ToIndex(limit) : BandSize() - 1;
+      const auto search = FindCumulative(
+          std::span<const Quantity>{quantities_}.subspan(best_,
+                                                         last - best_ + 1),
+          needed);
+      if (search.total_ >= needed)
+        return true;
+      needed -= search.total_;
+
+      if (InBand(limit))
+        return false;
+    }
+
+    for (; level != overflow_.end(); ++level) {
+      if (Compare{}(limit, level->first))
+        return false;
+      if (level->second.data_.quantity_ >= needed)
+        return true;
+      needed -= level->second.data_.quantity_;
+    }
+
+    return false;
+  }
+
+  /**
+   * Visit every level from the best price to the worst. `visit(price, data)`
+   * returns false to stop early.
+   *
+   * Overflow prices are either all better or all worse than anything in the
+   * band, so a single pass over the map split around the band is enough to
+   * keep everything in price order.
+   */
+  template <typename Visitor> void ForEachLevel(Visitor &&visit) const {
+    auto level = overflow_.begin();
+
+    for (; level != overflow_.end(); ++level) {
+      if (!AheadOfBand(level->first))
+        break;
+      if (!visit(level->first, level->second.data_))
+        return;
+    }
+
+    for (auto index = NextOccupied(0); index != BandSize();
+         index = NextOccupied(index + 1)) {
+      if (!visit(ToPrice(index), LevelData{quantities_[index], counts_[index]}))
+        return;
+    }
+
+    for (; level != overflow_.end(); ++level) {
+      if (!visit(level->first, level->second.data_))
+        return;
+    }
+  }
+};
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+// What happens when an order would trade with a resting order from the same
+// account. The incoming order's setting decides.
+enum class SelfTradePrevention : std::uint8_t {
+  None,          // trade as normal
+  CancelNewest,  // cancel what's left of the incoming order
+  CancelOldest,  // cancel the resting order and keep matching
+  DecrementBoth, // take the smaller quantity off both, without a trade
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+// A value that one thread publishes and any number of threads read, without
+// either side ever blocking the other.
+//
+// The writer bumps the sequence to odd, writes, and bumps it back to even.
+// Readers copy the value out and retry if the sequence was odd or moved while
+// they were copying. The payload is held as atomic words rather than as a T,
+// so a reader racing the writer reads torn words (and retries), never a data
+// race.
+template <typename T> class Seqlock {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "Seqlock values are copied around as plain bytes");
+
+public:
+  // Only one thread may store at a time
+  void Store(const T &value) {
+    std::array<std::uint64_t, Words> buffer{};
+    std::memcpy(buffer.data(), &value, sizeof(T));
+
+    const auto sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (std::size_t word = 0; word < Words; ++word)
+      words_[word].store(buffer[word], std::memory_order_relaxed);
+
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  T Load() const {
+    std::array<std::uint64_t, Words> buffer;
+
+    while (true) {
+      const auto before = sequence_.load(std::memory_order_acquire);
+      if (before & 1) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      for (std::size_t word = 0; word < Words; ++word)
+        buffer[word] = words_[word].load(std::memory_order_relaxed);
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence_.load(std::memory_order_relaxed) == before)
+        break;
+    }
+
+    // T is trivially copyable (asserted above), but may have member
+    // initializers, which -Wclass-memaccess would otherwise warn about
+    T value;
+    std::memcpy(static_cast<void *>(&value), buffer.data(), sizeof(T));
+    return value;
+  }
+
+private:
+  static constexpr std::size_t Words = (sizeof(T) + 7) / 8;
+
+  alignas(64) std::atomic<std::uint64_t> sequence_{0};
+  std::array<std::atomic<std::uint64_t>, Words> words_{};
+};
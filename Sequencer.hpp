@@ -0,0 +1,178 @@
+#pragma once
+
+#include "OrderCommand.hpp"
+#include "Orderbook.hpp"
+#include "SpscRing.hpp"
+#include "TradeInfo.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+enum class ReportType : std::uint8_t {
+  // A trade produced by the command
+  Trade,
+  // The command has been fully processed; nothing else will carry its tag
+  Completed,
+};
+
+// What the matching thread hands back, one entry per trade plus one
+// completion per command. Everything is plain values so it fits in a ring.
+struct ExecutionReport {
+  ReportType type_{ReportType::Completed};
+  std::uint64_t tag_{};
+  TradeInfo bidTrade_{};
+  TradeInfo askTrade_{};
+  SymbolId symbol_{};
+};
+
+// Runs one command against a book, handing its trades to `onTrade`
+inline void ApplyCommand(Orderbook &orderbook, const OrderCommand &command,
+                         TradeSink onTrade) {
+  switch (command.type_) {
+  case CommandType::Add:
+    orderbook.AddOrder(command.ToOrder(), onTrade);
+    break;
+  case CommandType::Modify:
+    orderbook.ModifyOrder(command.ToOrderModify(), onTrade);
+    break;
+  case CommandType::Cancel:
+    orderbook.CancelOrder(command.orderId_);
+    break;
+  case CommandType::Expire:
+    orderbook.ExpireOrders(std::chrono::system_clock::now());
+    break;
+  case CommandType::BeginAuction:
+    orderbook.BeginAuction();
+    break;
+  case CommandType::Uncross:
+    orderbook.Uncross(onTrade);
+    break;
+  }
+}
+
+/**
+ * Single-writer front end for an Orderbook.
+ *
+ * Each producer (say, one per gateway thread) gets its own SPSC ring, and one
+ * dedicated matching thread drains them all into a book it owns outright. The
+ * book runs in ThreadingMode::SingleWriter, so ordersMutex_ is never touched;
+ * the only cross-thread traffic is the ring indices.
+ *
+ * Reports go out through a single outbound ring, so there is exactly one
+ * consumer of results.
+ */
+class Sequencer {
+private:
+  // How many commands we take from one producer before moving on to the
+  // next, so a busy gateway can't starve the others
+  static constexpr std::size_t DrainBatch = 256;
+
+  std::vector<std::unique_ptr<SpscRing<OrderCommand>>> ingress_;
+  SpscRing<ExecutionReport> outbound_;
+  Orderbook orderbook_;
+  std::atomic<bool> stop_{false};
+  std::thread matchingThread_;
+
+  static OrderbookConfig SingleWriter(OrderbookConfig config) {
+    config.threadingMode_ = ThreadingMode::SingleWriter;
+    return config;
+  }
+
+  // The outbound ring is bounded too. Trades can't be dropped, so if the
+  // consumer falls behind the matching thread waits for it.
+  void Publish(const ExecutionReport &report) {
+    while (!outbound_.TryPush(report))
+      std::this_thread::yield();
+  }
+
+  void Apply(const OrderCommand &command) {
+    ApplyCommand(orderbook_, command, [this, &command](const Trade &trade) {
+      Publish(ExecutionReport{ReportType::Trade, command.tag_,
+                              trade.GetBidTrade(), trade.GetAskTrade(),
+                              command.symbol_});
+    });
+
+    Publish(ExecutionReport{ReportType::Completed, command.tag_, {}, {},
+                            command.symbol_});
+  }
+
+  std::size_t Drain() {
+    std::size_t applied{};
+    OrderCommand command;
+
+    for (auto &ring : ingress_) {
+      for (std::size_t taken = 0; taken < DrainBatch && ring->TryPop(command);
+           ++taken, ++applied)
+        Apply(command);
+    }
+
+    return applied;
+  }
+
+  void Run() {
+    using namespace std::chrono;
+
+    while (!stop_.load(std::memory_order_acquire)) {
+      const auto applied = Drain();
+
+      // We own the book, so expiring orders is just another thing the
+      // matching thread does between commands, one bounded chunk at a time
+      const auto now = system_clock::now();
+      if (now >= orderbook_.NextExpiry())
+        orderbook_.ExpireOrders(now);
+
+      if (applied == 0)
+        std::this_thread::yield();
+    }
+
+    // Anything producers pushed before Stop() still gets processed
+    while (Drain() != 0) {
+    }
+  }
+
+public:
+  Sequencer(std::size_t producers, std::size_t capacity,
+            const OrderbookConfig &config = {})
+      : outbound_{capacity}, orderbook_{SingleWriter(config)} {
+    ingress_.reserve(producers);
+    for (std::size_t producer = 0; producer < producers; ++producer)
+      ingress_.push_back(std::make_unique<SpscRing<OrderCommand>>(capacity));
+
+    matchingThread_ = std::thread{[this] { Run(); }};
+  }
+
+  Sequencer(const Sequencer &) = delete;
+  void operator=(const Sequencer &) = delete;
+  Sequencer(Sequencer &&) = delete;
+  void operator=(Sequencer &&) = delete;
+
+  ~Sequencer() { Stop(); }
+
+  // Must only be called from the thread that owns `producer`. Returns false if
+  // that producer's ring is full.
+  bool TrySubmit(std::size_t producer, const OrderCommand &command) {
+    return ingress_[producer]->TryPush(command);
+  }
+
+  // Must only be called from the single consumer thread
+  bool TryPoll(ExecutionReport &report) { return outbound_.TryPop(report); }
+
+  /**
+   * Drains whatever has been submitted and joins the matching thread. The
+   * consumer must keep polling until this returns, otherwise a full outbound
+   * ring would stall the final drain.
+   */
+  void Stop() {
+    if (!matchingThread_.joinable())
+      return;
+
+    stop_.store(true, std::memory_order_release);
+    matchingThread_.join();
+  }
+
+  // The book belongs to the matching thread; only look at it after Stop()
+  const Orderbook &GetOrderbook() const { return orderbook_; }
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <ctime>
+
+// GoodForDay orders live until the end of the trading session, say 4pm local
+// time. `close` is the time of day the session ends at, as an offset from
+// local midnight.
+inline std::chrono::system_clock::time_point
+NextSessionClose(std::chrono::system_clock::time_point now,
+                 std::chrono::minutes close = std::chrono::hours(16)) {
+  // This brings the std::chrono namespace into scope so you can use its
+  // contents without typing std::chrono:: every time. Without it:
+  // std::chrono::hours(16)
+  // std::chrono::system_clock::now()
+  // With it:
+  // hours(16)
+  // system_clock::now()
+  using namespace std::chrono;
+  const auto end = duration_cast<hours>(close);
+  const auto endMinutes = (close - end).count();
+
+  const auto now_c = system_clock::to_time_t(now);
+  std::tm now_parts;
+  localtime_r(&now_c, &now_parts);
+
+  if (now_parts.tm_hour * 60 + now_parts.tm_min >= close.count())
+    now_parts.tm_mday += 1;
+
+  now_parts.tm_hour = end.count();
+  now_parts.tm_min = endMinutes;
+  now_parts.tm_sec = 0;
+  // Let mktime work out whether DST applies on the day we land on
+  now_parts.tm_isdst = -1;
+
+  return system_clock::from_time_t(mktime(&now_parts));
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "Usings.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * One thread that keeps time for many books.
+ *
+ * The scheduler only decides *when*: each target tells it the next time it
+ * has something to expire, and once that time comes the scheduler calls the
+ * target's `post`, which hands an expiry pass to whoever owns the book. For
+ * books owned by a worker thread (see OrderbookManager.hpp) that means
+ * flagging the worker; a locked Orderbook posts the pass straight into its
+ * own public API, where it queues for the lock like any other command.
+ *
+ * After posting, a target's deadline is cleared. The owner is expected to
+ * Reschedule once it has done its expiry pass, which also means a target is
+ * never posted again while an earlier post is still pending.
+ *
+ * The scheduler has its own mutex, which is only taken when a deadline is
+ * (re)scheduled, never on the matching path. Posts run with it released, so
+ * a post may itself Reschedule, or take a lock that a Reschedule caller
+ * holds.
+ */
+class SessionScheduler {
+private:
+  struct Target {
+    ExpiryTime deadline_{ExpiryTime::max()};
+    std::function<void()> post_;
+  };
+
+  std::vector<Target> targets_;
+  // Targets found due on this wake-up, posted once the lock is dropped
+  std::vector<std::size_t> due_;
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  // When the thread is currently planning to wake, so Reschedule only
+  // bothers it for deadlines that come sooner
+  ExpiryTime planned_{ExpiryTime::max()};
+  bool rescheduled_{false};
+  bool stop_{false};
+  std::thread thread_;
+
+  void Run() {
+    std::unique_lock lock{mutex_};
+
+    while (!stop_) {
+      planned_ = ExpiryTime::max();
+      for (const auto &target : targets_)
+        planned_ = std::min(planned_, target.deadline_);
+      rescheduled_ = false;
+
+      auto Woken = [this] { return stop_ || rescheduled_; };
+      // wait_until doesn't like a time_point of max(), so with nothing
+      // scheduled we simply wait to be told
+      if (planned_ == ExpiryTime::max())
+        wakeup_.wait(lock, Woken);
+      else if (wakeup_.wait_until(lock, planned_, Woken))
+        continue;
+
+      if (stop_)
+        return;
+
+      const auto now = std::chrono::system_clock::now();
+      for (std::size_t index = 0; index < targets_.size(); ++index) {
+        if (targets_[index].deadline_ > now)
+          continue;
+        targets_[index].deadline_ = ExpiryTime::max();
+        due_.push_back(index);
+      }
+
+      // targets_ itself never changes after Start(), so the posts can be
+      // read without the lock
+      lock.unlock();
+      for (const auto index : due_)
+        targets_[index].post_();
+      lock.lock();
+      due_.clear();
+    }
+  }
+
+public:
+  SessionScheduler() = default;
+  SessionScheduler(const SessionScheduler &) = delete;
+  void operator=(const SessionScheduler &) = delete;
+
+  ~SessionScheduler() { Stop(); }
+
+  // Targets are registered up front, before Start(). `post` runs on the
+  // scheduler's thread and holds up every other target while it runs, so it
+  // should hand work off (or at most run one short command), not do it all.
+  std::size_t Register(std::function<void()> post) {
+    targets_.push_back(Target{ExpiryTime::max(), std::move(post)});
+    due_.reserve(targets_.size());
+    return targets_.size() - 1;
+  }
+
+  void Start() {
+    thread_ = std::thread{[this] { Run(); }};
+  }
+
+  void Reschedule(std::size_t target, ExpiryTime deadline) {
+    std::scoped_lock lock{mutex_};
+    targets_[target].deadline_ = deadline;
+    if (deadline < planned_) {
+      rescheduled_ = true;
+      wakeup_.notify_one();
+    }
+  }
+
+  void Stop() {
+    if (!thread_.joinable())
+      return;
+
+    {
+      std::scoped_lock lock{mutex_};
+      stop_ = true;
+    }
+    wakeup_.notify_one();
+    thread_.join();
+  }
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Side.hpp"
+#include "Usings.hpp"
+#include <functional>
+#include <type_traits>
+
+// Everything that differs between the two sides of the book, as types and
+// constants, so side-specific code can be written once as a template and
+// compiled twice instead of branching on Side at runtime.
+template <Side S> struct SideTraits;
+
+template <> struct SideTraits<Side::Buy> {
+  // Highest bid first
+  using Compare = std::greater<Price>;
+  static constexpr Side Opposite = Side::Sell;
+};
+
+template <> struct SideTraits<Side::Sell> {
+  // Lowest ask first
+  using Compare = std::less<Price>;
+  static constexpr Side Opposite = Side::Buy;
+};
+
+// Whether an order on side S at `price` can trade with a resting order on the
+// other side at `other`: a bid at or above the ask, or an ask at or below the
+// bid.
+template <Side S> constexpr bool Crosses(Price price, Price other) {
+  return !typename SideTraits<S>::Compare{}(other, price);
+}
+
+// Turns a runtime Side into a compile-time one. Hot paths do this once, on
+// the way in, and everything below is specialised for that side.
+template <typename Visitor>
+decltype(auto) DispatchSide(Side side, Visitor &&visit) {
+  if (side == Side::Buy)
+    return visit(std::integral_constant<Side, Side::Buy>{});
+  return visit(std::integral_constant<Side, Side::Sell>{});
+}
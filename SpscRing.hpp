@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+// A bounded, lock-free queue for exactly one producer thread and exactly one
+// consumer thread.
+//
+// Each side owns its own index and only ever reads the other's, so the only
+// synchronisation is an acquire/release pair per operation. Each side also
+// keeps a cached copy of the other's index, so we only touch the shared cache
+// line when the cached value says the ring looks full (or empty).
+template <typename T> class SpscRing {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "SpscRing slots are copied around as plain bytes");
+
+public:
+  // Capacity is rounded up to a power of two so wrapping is just a mask
+  explicit SpscRing(std::size_t capacity)
+      : slots_(std::bit_ceil(capacity < 2 ? 2 : capacity)),
+        mask_{slots_.size() - 1} {}
+
+  SpscRing(const SpscRing &) = delete;
+  void operator=(const SpscRing &) = delete;
+
+  // Producer side. Returns false if the ring is full.
+  bool TryPush(const T &value) {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cachedHead_ == slots_.size()) {
+      cachedHead_ = head_.load(std::memory_order_acquire);
+      if (tail - cachedHead_ == slots_.size())
+        return false;
+    }
+
+    slots_[tail & mask_] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false if the ring is empty.
+  bool TryPop(T &value) {
+    const auto head = head_.load(std::memory_order_relaxed);
+    if (head == cachedTail_) {
+      cachedTail_ = tail_.load(std::memory_order_acquire);
+      if (head == cachedTail_)
+        return false;
+    }
+
+    value = slots_[head & mask_];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Only a hint when called from a thread that is neither end of the ring
+  bool Empty() const {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+
+  std::size_t Capacity() const { return slots_.size(); }
+
+private:
+  static constexpr std::size_t CacheLine = 64;
+
+  std::vector<T> slots_;
+  std::size_t mask_;
+
+  // Written by the consumer
+  alignas(CacheLine) std::atomic<std::size_t> head_{0};
+  std::size_t cachedTail_{0};
+
+  // Written by the producer
+  alignas(CacheLine) std::atomic<std::size_t> tail_{0};
+  std::size_t cachedHead_{0};
+};
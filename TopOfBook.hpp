@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Usings.hpp"
+#include <optional>
+
+// The best level on one side: its price, total quantity and how many orders
+// make it up
+struct TouchLevel {
+  Price price_;
+  Quantity quantity_;
+  Quantity count_;
+};
+
+// Either side is empty when there's nothing resting on it
+struct TopOfBook {
+  std::optional<TouchLevel> bid_;
+  std::optional<TouchLevel> ask_;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Trade.hpp"
+#include <concepts>
+#include <memory>
+#include <type_traits>
+
+// A non-owning reference to anything callable as `void(const Trade &)`.
+//
+// The book hands every trade to the sink the moment it's generated, so callers
+// that forward fills straight onto a wire never pay for a Trades vector. It is
+// just two pointers, cheap to pass by value, and the callable it refers to
+// must outlive the call it's passed to (a lambda written inline at the call
+// site always does).
+class TradeSink {
+public:
+  template <typename Callable>
+    requires(!std::same_as<std::remove_cvref_t<Callable>, TradeSink> &&
+             std::invocable<Callable &, const Trade &>)
+  TradeSink(Callable &&callable)
+      : callable_{const_cast<void *>(
+            static_cast<const void *>(std::addressof(callable)))},
+        invoke_{[](void *callable, const Trade &trade) {
+          (*static_cast<std::remove_reference_t<Callable> *>(callable))(trade);
+        }} {}
+
+  void operator()(const Trade &trade) const { invoke_(callable_, trade); }
+
+private:
+  void *callable_;
+  void (*invoke_)(void *, const Trade &);
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 #include <vector>
 
@@ -8,3 +9,10 @@ using Price = std::int32_t;
 using Quantity = std::uint32_t;
 using OrderId = std::uint64_t;
 using OrderIds = std::vector<OrderId>;
+using ExpiryTime = std::chrono::sys_seconds;
+// Identifies an instrument, i.e. one Orderbook, inside an OrderbookManager
+using SymbolId = std::uint32_t;
+// Who owns an order, for self-trade prevention. NoAccount orders are never
+// checked.
+using AccountId = std::uint32_t;
+inline constexpr AccountId NoAccount = 0;
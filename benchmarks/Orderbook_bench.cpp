@@ -0,0 +1,391 @@
+#include "../OrderEntry.hpp"
+#include "../Orderbook.hpp"
+#include "../ParallelUncross.hpp"
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Google Benchmark reports the mean time per iteration. For a matching engine
+// the tail matters more than the mean, so every scenario also times each
+// operation on its own and reports the percentiles as counters.
+class LatencyRecorder {
+public:
+  explicit LatencyRecorder(benchmark::State &state) : state_{state} {
+    samples_.reserve(static_cast<std::size_t>(state.max_iterations));
+  }
+
+  template <typename Operation> void Measure(Operation &&operation) {
+    const auto start = std::chrono::steady_clock::now();
+    operation();
+    const auto end = std::chrono::steady_clock::now();
+    samples_.push_back(
+        std::chrono::duration<double, std::nano>(end - start).count());
+  }
+
+  ~LatencyRecorder() {
+    state_.SetItemsProcessed(state_.iterations());
+    if (samples_.empty())
+      return;
+
+    std::sort(samples_.begin(), samples_.end());
+    auto Percentile = [this](double percentile) {
+      const auto index = static_cast<std::size_t>(
+          percentile * static_cast<double>(samples_.size() - 1));
+      return samples_[index];
+    };
+
+    state_.counters["p50_ns"] = Percentile(0.50);
+    state_.counters["p99_ns"] = Percentile(0.99);
+    state_.counters["p99.9_ns"] = Percentile(0.999);
+  }
+
+private:
+  benchmark::State &state_;
+  std::vector<double> samples_;
+};
+
+constexpr Price Mid = 10'000;
+
+Order Limit(OrderId orderId, Side side, Price price, Quantity quantity) {
+  return Order{OrderType::GoodTillCancel, orderId, side, price, quantity};
+}
+
+// `levels` price levels per side around Mid, `ordersPerLevel` orders each.
+// Returns the next free order id.
+OrderId FillBook(Orderbook &orderbook, Price levels, int ordersPerLevel,
+                 Quantity quantity = 10) {
+  OrderId orderId = 1;
+  for (Price level = 1; level <= levels; ++level) {
+    for (int order = 0; order < ordersPerLevel; ++order) {
+      orderbook.AddOrder(Limit(orderId++, Side::Buy, Mid - level, quantity));
+      orderbook.AddOrder(Limit(orderId++, Side::Sell, Mid + level, quantity));
+    }
+  }
+  return orderId;
+}
+
+// Resting orders only, spread over a few hundred ticks either side of the mid
+void BM_AddOnly(benchmark::State &state) {
+  Orderbook orderbook;
+  std::mt19937_64 random{42};
+  std::uniform_int_distribution<Price> offset{1, 300};
+  std::uniform_int_distribution<Quantity> quantity{1, 100};
+  OrderId orderId = 1;
+
+  LatencyRecorder recorder{state};
+  for (auto _ : state) {
+    const auto side = orderId % 2 ? Side::Buy : Side::Sell;
+    const auto price = side == Side::Buy ? Mid - offset(random)
+                                         : Mid + offset(random);
+    const Order order = Limit(orderId++, side, price, quantity(random));
+    recorder.Measure([&] { orderbook.AddOrder(order); });
+  }
+}
+BENCHMARK(BM_AddOnly);
+
+// Steady-state book: every add is paired with a cancel of the oldest order
+void BM_AddCancelChurn(benchmark::State &state) {
+  const auto resting = static_cast<std::size_t>(state.range(0));
+  Orderbook orderbook;
+  std::mt19937_64 random{42};
+  std::uniform_int_distribution<Price> offset{1, 300};
+  std::deque<OrderId> live;
+  OrderId orderId = 1;
+
+  auto Add = [&] {
+    const auto side = orderId % 2 ? Side::Buy : Side::Sell;
+    const auto price = side == Side::Buy ? Mid - offset(random)
+                                         : Mid + offset(random);
+    live.push_back(orderId);
+    return Limit(orderId++, side, price, 10);
+  };
+
+  while (live.size() < resting)
+    orderbook.AddOrder(Add());
+
+  LatencyRecorder recorder{state};
+  for (auto _ : state) {
+    const Order order = Add();
+    const auto cancel = live.front();
+    live.pop_front();
+    recorder.Measure([&] {
+      orderbook.AddOrder(order);
+      orderbook.CancelOrder(cancel);
+    });
+  }
+}
+BENCHMARK(BM_AddCancelChurn)->Arg(1'000)->Arg(100'000);
+
+// Like tests/TestFiles/Match_Market.txt, but sweeping `range(0)` levels of
+// several orders each. Every iteration puts the liquidity back first.
+void BM_MarketSweep(benchmark::State &state) {
+  const auto levels = static_cast<Price>(state.range(0));
+  constexpr int OrdersPerLevel = 4;
+  constexpr Quantity OrderQuantity = 10;
+
+  // Resting bids below the swept levels, which the sweep never reaches
+  Orderbook orderbook;
+  OrderId orderId = 1;
+  for (Price level = 1; level <= 50; ++level)
+    orderbook.AddOrder(Limit(orderId++, Side::Buy, Mid - level, OrderQuantity));
+
+  LatencyRecorder recorder{state};
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (Price level = 0; level < levels; ++level)
+      for (int order = 0; order < OrdersPerLevel; ++order)
+        orderbook.AddOrder(
+            Limit(orderId++, Side::Buy, Mid + 100 - level, OrderQuantity));
+    state.ResumeTiming();
+
+    const Order market{OrderType::Market, orderId++, Side::Sell, 0,
+                       static_cast<Quantity>(levels) * OrdersPerLevel *
+                           OrderQuantity};
+    recorder.Measure([&] { orderbook.AddOrder(market); });
+  }
+}
+BENCHMARK(BM_MarketSweep)->Arg(1)->Arg(10)->Arg(100);
+
+// FillOrKill orders against a deep book. Half of them can't be filled inside
+// their limit and get rejected, the other half take one order at the touch
+// which we then put back.
+void BM_FillOrKillHeavy(benchmark::State &state) {
+  Orderbook orderbook;
+  OrderId orderId = FillBook(orderbook, static_cast<Price>(state.range(0)), 2);
+  std::mt19937_64 random{42};
+  std::bernoulli_distribution miss{0.5};
+
+  LatencyRecorder recorder{state};
+  for (auto _ : state) {
+    const bool missing = miss(random);
+    const Order order{OrderType::FillOrKill, orderId++, Side::Buy, Mid + 1,
+                      missing ? Quantity{1'000'000} : Quantity{10}};
+    recorder.Measure([&] { orderbook.AddOrder(order); });
+
+    if (!missing) {
+      state.PauseTiming();
+      orderbook.AddOrder(Limit(orderId++, Side::Sell, Mid + 1, 10));
+      state.ResumeTiming();
+    }
+  }
+}
+BENCHMARK(BM_FillOrKillHeavy)->Arg(10)->Arg(1'000);
+
+// FillOrKill orders that walk every ask level before finding out they can't
+// fill, so the feasibility scan over the whole depth is all that's timed
+void BM_FillOrKillDeep(benchmark::State &state) {
+  const auto levels = static_cast<Price>(state.range(0));
+  Orderbook orderbook;
+  OrderId orderId = FillBook(orderbook, levels, 2);
+
+  LatencyRecorder recorder{state};
+  for (auto _ : state) {
+    const Order order{OrderType::FillOrKill, orderId++, Side::Buy,
+                      Mid + levels, Quantity{4'000'000'000}};
+    recorder.Measure([&] { orderbook.AddOrder(order); });
+  }
+}
+BENCHMARK(BM_FillOrKillDeep)->Arg(100)->Arg(1'000);
+
+// Snapshots of a deep book, both the full book and the top 10 levels
+void BM_GetOrderInfos(benchmark::State &state) {
+  const auto depth = static_cast<std::size_t>(state.range(1));
+  Orderbook orderbook;
+  FillBook(orderbook, static_cast<Price>(state.range(0)), 4);
+
+  LatencyRecorder recorder{state};
+  for (auto _ : state) {
+    recorder.Measure([&] {
+      benchmark::DoNotOptimize(depth == 0 ? orderbook.GetOrderInfos()
+                                          : orderbook.GetOrderInfos(depth));
+    });
+  }
+}
+BENCHMARK(BM_GetOrderInfos)->Args({1'000, 0})->Args({1'000, 10});
+
+// Modifies of resting orders: a mix of size changes at the same price and
+// moves to a new price, never crossing the spread
+void BM_ModifyStorm(benchmark::State &state) {
+  const auto resting = static_cast<OrderId>(state.range(0));
+  Orderbook orderbook;
+  std::mt19937_64 random{42};
+  std::uniform_int_distribution<Price> offset{1, 300};
+  std::uniform_int_distribution<OrderId> pick{1, resting};
+  std::uniform_int_distribution<Quantity> quantity{1, 100};
+
+  auto SideOf = [](OrderId orderId) {
+    return orderId % 2 ? Side::Buy : Side::Sell;
+  };
+  auto PriceFor = [&](Side side) {
+    return side == Side::Buy ? Mid - offset(random) : Mid + offset(random);
+  };
+
+  for (OrderId orderId = 1; orderId <= resting; ++orderId)
+    orderbook.AddOrder(
+        Limit(orderId, SideOf(orderId), PriceFor(SideOf(orderId)), 50));
+
+  LatencyRecorder recorder{state};
+  for (auto _ : state) {
+    const auto orderId = pick(random);
+    const auto side = SideOf(orderId);
+    const OrderModify modify{orderId, side, PriceFor(side), quantity(random)};
+    recorder.Measure([&] { orderbook.ModifyOrder(modify); });
+  }
+}
+BENCHMARK(BM_ModifyStorm)->Arg(10'000);
+
+// A warm start: `range(0)` resting orders loaded from a checkpoint into a
+// fresh book. Building and tearing down the book isn't timed.
+void BM_RestoreCheckpoint(benchmark::State &state) {
+  OrderbookConfig config;
+  config.threadingMode_ = ThreadingMode::SingleWriter;
+
+  BookCheckpoint checkpoint;
+  {
+    Orderbook orderbook{config};
+    FillBook(orderbook, 500, static_cast<int>(state.range(0) / 1'000));
+    checkpoint = orderbook.Checkpoint();
+  }
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto orderbook = std::make_unique<Orderbook>(config);
+    state.ResumeTiming();
+
+    orderbook->Restore(checkpoint);
+
+    state.PauseTiming();
+    orderbook.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<std::int64_t>(checkpoint.records_.size()));
+}
+BENCHMARK(BM_RestoreCheckpoint)
+    ->Arg(100'000)
+    ->Arg(2'000'000)
+    ->Unit(benchmark::kMillisecond);
+
+// The open: `range(0)` books that each collected 200 crossing orders during
+// the call phase, uncrossed on `range(1)` threads. Filling the books isn't
+// timed.
+void BM_OpeningUncross(benchmark::State &state) {
+  OrderbookConfig config;
+  config.threadingMode_ = ThreadingMode::SingleWriter;
+  config.priceBandLevels_ = 64;
+  const auto bookCount = static_cast<std::size_t>(state.range(0));
+  const auto threads = static_cast<std::size_t>(state.range(1));
+
+  std::mt19937 random{7};
+  std::uniform_int_distribution<Price> price{90, 110};
+  std::uniform_int_distribution<Quantity> quantity{1, 100};
+  std::uint64_t trades{};
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<std::unique_ptr<Orderbook>> books;
+    std::vector<Orderbook *> raw;
+    for (std::size_t book = 0; book < bookCount; ++book) {
+      books.push_back(std::make_unique<Orderbook>(config));
+      books.back()->BeginAuction();
+      for (OrderId id = 1; id <= 200; ++id)
+        books.back()->AddOrder(Order{OrderType::GoodTillCancel, id,
+                                     id % 2 ? Side::Buy : Side::Sell,
+                                     price(random), quantity(random)});
+      raw.push_back(books.back().get());
+    }
+    std::atomic<std::uint64_t> count{0};
+    state.ResumeTiming();
+
+    const auto results = UncrossInParallel(
+        raw, threads, [&count](std::size_t, const Trade &) {
+          count.fetch_add(1, std::memory_order_relaxed);
+        });
+    benchmark::DoNotOptimize(results.data());
+
+    state.PauseTiming();
+    trades += count.load();
+    books.clear();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<std::int64_t>(bookCount));
+  state.counters["trades/iter"] = benchmark::Counter(
+      static_cast<double>(trades), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_OpeningUncross)
+    ->Args({5'000, 1})
+    ->Args({5'000, 4})
+    ->Unit(benchmark::kMillisecond);
+
+// Wire to match: binary order-entry frames (adds around the touch, with
+// every other order cancelled again) decoded in place and applied, one
+// 64KB receive buffer at a time
+void BM_DecodeOrderEntry(benchmark::State &state) {
+  OrderbookConfig config;
+  config.threadingMode_ = ThreadingMode::SingleWriter;
+  config.expectedOrders_ = 1 << 16;
+
+  std::mt19937 random{11};
+  std::uniform_int_distribution<Price> offset{-20, 20};
+  std::vector<std::byte> wire(std::size_t{1} << 22);
+  std::size_t size{};
+  std::size_t messages{};
+  for (OrderId id = 1;; ++id) {
+    const auto side = id % 2 ? Side::Buy : Side::Sell;
+    const auto price = static_cast<Price>(
+        (side == Side::Buy ? 95 : 105) + offset(random));
+    const auto written = EncodeEnterOrder(
+        std::span{wire}.subspan(size),
+        Order{OrderType::GoodTillCancel, id, side, price, 10});
+    if (written == 0)
+      break;
+    size += written;
+    ++messages;
+    if (id % 2 == 0) {
+      const auto cancelled =
+          EncodeCancelOrder(std::span{wire}.subspan(size), id - 1);
+      if (cancelled == 0)
+        break;
+      size += cancelled;
+      ++messages;
+    }
+  }
+
+  constexpr std::size_t ReceiveSize = 64 * 1024;
+  std::uint64_t trades{};
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto orderbook = std::make_unique<Orderbook>(config);
+    state.ResumeTiming();
+
+    // Whatever a receive cuts off goes at the front of the next one, the
+    // way a gateway would carry it over
+    std::size_t used{};
+    while (used < size) {
+      const auto end = std::min(size, used + ReceiveSize);
+      used += ApplyOrderEntry(*orderbook,
+                              std::span{wire}.subspan(used, end - used),
+                              [&trades](const Trade &) { ++trades; });
+    }
+
+    state.PauseTiming();
+    orderbook.reset();
+    state.ResumeTiming();
+  }
+  benchmark::DoNotOptimize(trades);
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<std::int64_t>(messages));
+}
+BENCHMARK(BM_DecodeOrderEntry)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
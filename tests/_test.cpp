@@ -1,11 +1,22 @@
 #include "pch.h"
 
 #include "../Orderbook.cpp"
+#include "../AsyncOrderbook.hpp"
+#include "../Checkpoint.hpp"
+#include "../JournalReplay.hpp"
+#include "../OrderEntry.hpp"
+#include "../OrderbookManager.hpp"
+#include "../ParallelUncross.hpp"
+#include "../Sequencer.hpp"
 #include "gtest/gtest.h"
 #include <cstddef>
+#include <filesystem>
 #include <fstream>
 #include <gtest/gtest.h>
 #include <memory>
+#include <memory_resource>
+#include <random>
+#include <unordered_map>
 #include <stdexcept>
 #include <string_view>
 
@@ -240,10 +251,1251 @@ void RunOrderbookTest(const char* filename) {
   ASSERT_EQ(orderbookInfos.GetAsks().size(), result.askCount_);
 }
 
+// An order from `account`, for the self-trade prevention tests
+Order Tagged(OrderType type, OrderId id, Side side, Price price,
+             Quantity quantity, AccountId account, SelfTradePrevention mode) {
+  Order order{type, id, side, price, quantity};
+  order.SetAccount(account, mode);
+  return order;
+}
+
 TEST(OrderbookTests, Match_GoodTillCancel) { RunOrderbookTest("Match_GoodTillCancel.txt"); }
 TEST(OrderbookTests, Match_FillAndKill) { RunOrderbookTest("Match_FillAndKill.txt"); }
 TEST(OrderbookTests, Match_FillOrKill_Hit) { RunOrderbookTest("Match_FillOrKill_Hit.txt"); }
 TEST(OrderbookTests, Match_FillOrKill_Miss) { RunOrderbookTest("Match_FillOrKill_Miss.txt"); }
+TEST(OrderbookTests, Match_FillOrKill_MultiLevel) { RunOrderbookTest("Match_FillOrKill_MultiLevel.txt"); }
+TEST(OrderbookTests, Match_FillOrKill_PastLimit) { RunOrderbookTest("Match_FillOrKill_PastLimit.txt"); }
 TEST(OrderbookTests, Cancel_Success) { RunOrderbookTest("Cancel_Success.txt"); }
 TEST(OrderbookTests, Modify_Side) { RunOrderbookTest("Modify_Side.txt"); }
 TEST(OrderbookTests, Match_Market) { RunOrderbookTest("Match_Market.txt"); }
+TEST(OrderbookTests, Match_OutOfBand) { RunOrderbookTest("Match_OutOfBand.txt"); }
+
+TEST(OrderbookTests, GetOrderInfos_OutOfBandInPriceOrder) {
+  OrderbookConfig config;
+  config.priceBandLevels_ = 64;
+  config.priceBandBase_ = 100;
+
+  Orderbook orderbook{config};
+  for (const auto &[orderId, price] : std::vector<std::pair<OrderId, Price>>{
+           {1, 120}, {2, 500}, {3, 10}, {4, 163}, {5, 100}}) {
+    orderbook.AddOrder(std::make_shared<Order>(OrderType::GoodTillCancel,
+                                               orderId, Side::Buy, price, 10));
+  }
+
+  const auto bids = orderbook.GetOrderInfos().GetBids();
+  std::vector<Price> prices;
+  for (const auto &level : bids)
+    prices.push_back(level.price_);
+
+  ASSERT_EQ(prices, (std::vector<Price>{500, 163, 120, 100, 10}));
+}
+
+TEST(OrderbookTests, PriceLadder_ReanchorsOverWhatItPullsIn) {
+  auto Prices = [](const LevelInfos &levels) {
+    std::vector<Price> prices;
+    for (const auto &level : levels)
+      prices.push_back(level.price_);
+    return prices;
+  };
+
+  // The band drains and moves to 61, taking in 60 from the overflow but
+  // leaving 70 and 50 where they are
+  OrderbookConfig config;
+  config.priceBandLevels_ = 4;
+  Orderbook orderbook{config};
+  for (const auto &[orderId, price] : std::vector<std::pair<OrderId, Price>>{
+           {1, 100}, {2, 70}, {3, 60}, {4, 50}})
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, orderId, Side::Buy,
+                             price, 10});
+  orderbook.CancelOrder(1);
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 5, Side::Buy, 61, 10});
+  ASSERT_EQ(Prices(orderbook.GetOrderInfos().GetBids()),
+            (std::vector<Price>{70, 61, 60, 50}));
+  ASSERT_EQ(
+      orderbook.AddOrder(Order{OrderType::FillAndKill, 6, Side::Sell, 60, 25})
+          .size(),
+      3u);
+  ASSERT_EQ(orderbook.GetBestBid()->price_, 60);
+
+  // With no band at all, every level is overflow
+  config.priceBandLevels_ = 0;
+  Orderbook unbanded{config};
+  unbanded.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Sell, 101, 5});
+  unbanded.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Sell, 100, 5});
+  ASSERT_EQ(Prices(unbanded.GetOrderInfos().GetAsks()),
+            (std::vector<Price>{100, 101}));
+  ASSERT_EQ(
+      unbanded.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Buy, 101, 7})
+          .size(),
+      2u);
+  ASSERT_EQ(unbanded.GetBestAsk()->quantity_, 3u);
+}
+
+TEST(SequencerTests, MatchesCommandsFromEveryProducer) {
+  Sequencer sequencer{2, 64};
+
+  auto Add = [](Side side, OrderId orderId) {
+    return OrderCommand{CommandType::Add, OrderType::GoodTillCancel, side, 100,
+                        10, orderId, orderId};
+  };
+
+  std::thread buyer{[&] { ASSERT_TRUE(sequencer.TrySubmit(0, Add(Side::Buy, 1))); }};
+  buyer.join();
+  std::thread seller{[&] { ASSERT_TRUE(sequencer.TrySubmit(1, Add(Side::Sell, 2))); }};
+  seller.join();
+  sequencer.Stop();
+
+  std::vector<ExecutionReport> reports;
+  ExecutionReport report;
+  while (sequencer.TryPoll(report))
+    reports.push_back(report);
+
+  ASSERT_EQ(reports.size(), 3u);
+  ASSERT_EQ(reports[0].type_, ReportType::Completed);
+  ASSERT_EQ(reports[1].type_, ReportType::Trade);
+  ASSERT_EQ(reports[1].tag_, 2u);
+  ASSERT_EQ(reports[1].bidTrade_.orderId_, 1u);
+  ASSERT_EQ(reports[1].askTrade_.orderId_, 2u);
+  ASSERT_EQ(reports[2].type_, ReportType::Completed);
+  ASSERT_EQ(sequencer.GetOrderbook().Size(), 0u);
+}
+
+// The smallest coroutine type there is: starts straight away, and nobody
+// waits for it
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+TEST(SequencerTests, AsyncOrderbook_ResumesWithEachCommandsTrades) {
+  // A ring far smaller than what's in flight, so most commands wait their
+  // turn inside the client
+  Sequencer sequencer{1, 4};
+  AsyncOrderbook client{sequencer, 0};
+
+  std::vector<std::size_t> tradesPerOrder(64);
+  auto Seller = [&](OrderId orderId) -> Detached {
+    const auto trades = co_await client.AddOrder(
+        Order{OrderType::GoodTillCancel, orderId, Side::Sell, 100, 1});
+    tradesPerOrder[orderId] = trades.size();
+  };
+  for (OrderId orderId = 0; orderId < 32; ++orderId)
+    Seller(orderId);
+  ASSERT_EQ(client.InFlight(), 32u);
+
+  std::size_t taken{};
+  auto Buyer = [&]() -> Detached {
+    // One after another, each starting only once the last has come back
+    for (OrderId orderId = 32; orderId < 48; ++orderId) {
+      const auto trades = co_await client.AddOrder(
+          Order{OrderType::GoodTillCancel, orderId, Side::Buy, 100, 2});
+      for (const auto &trade : trades)
+        taken += trade.GetBidTrade().quantity;
+    }
+    co_await client.CancelOrder(0);
+  };
+  Buyer();
+
+  while (client.InFlight() != 0)
+    client.Poll();
+  sequencer.Stop();
+
+  ASSERT_EQ(taken, 32u);
+  ASSERT_EQ(tradesPerOrder[0], 0u);
+  ASSERT_EQ(sequencer.GetOrderbook().Size(), 0u);
+}
+
+TEST(SequencerTests, AsyncOrderbook_FailsEverythingOnAForeignReport) {
+  Sequencer sequencer{1, 8};
+  AsyncOrderbook client{sequencer, 0};
+
+  std::vector<OrderId> resumed;
+  std::size_t failed{};
+  auto Send = [&](Order order) -> Detached {
+    try {
+      co_await client.AddOrder(order);
+      resumed.push_back(order.GetOrderId());
+    } catch (const std::logic_error &) {
+      ++failed;
+    }
+  };
+
+  // Reports come back in submission order, one resume per request
+  for (OrderId orderId = 1; orderId <= 3; ++orderId)
+    Send(Order{OrderType::GoodTillCancel, orderId, Side::Sell, 100, 1});
+  while (client.InFlight() != 0)
+    client.Poll();
+  ASSERT_EQ(resumed, (std::vector<OrderId>{1, 2, 3}));
+
+  // Someone else on the same ring, against the rules: its report arrives
+  // first, and nothing in flight is left hanging on it
+  OrderCommand foreign = OrderCommand::ForCancel(42);
+  foreign.tag_ = 999;
+  ASSERT_TRUE(sequencer.TrySubmit(0, foreign));
+  Send(Order{OrderType::GoodTillCancel, 4, Side::Sell, 101, 1});
+  Send(Order{OrderType::GoodTillCancel, 5, Side::Sell, 102, 1});
+  while (client.InFlight() != 0)
+    client.Poll();
+  sequencer.Stop();
+
+  ASSERT_EQ(failed, 2u);
+  ASSERT_EQ(resumed.size(), 3u);
+}
+
+TEST(OrderbookManagerTests, RoutesEachSymbolToItsOwnBook) {
+  OrderbookManagerConfig config;
+  config.workers_ = 2;
+  const std::vector<SymbolId> symbols{7, 8, 9};
+  OrderbookManager manager{config, symbols};
+
+  ASSERT_EQ(manager.WorkerFor(7), 0u);
+  ASSERT_EQ(manager.WorkerFor(8), 1u);
+  ASSERT_EQ(manager.WorkerFor(9), 0u);
+
+  auto Add = [](SymbolId symbol, Side side, OrderId orderId) {
+    return OrderCommand{CommandType::Add, OrderType::GoodTillCancel, side, 100,
+                        10, orderId, orderId, symbol};
+  };
+
+  // The same order ids on different symbols never meet
+  ASSERT_TRUE(manager.TrySubmit(0, Add(7, Side::Buy, 1)));
+  ASSERT_TRUE(manager.TrySubmit(0, Add(8, Side::Sell, 2)));
+  ASSERT_TRUE(manager.TrySubmit(0, Add(9, Side::Buy, 1)));
+  ASSERT_TRUE(manager.TrySubmit(0, Add(9, Side::Sell, 2)));
+  manager.Stop();
+
+  std::vector<ExecutionReport> trades;
+  ExecutionReport report;
+  for (std::size_t worker = 0; worker < manager.Workers(); ++worker) {
+    while (manager.TryPoll(worker, report)) {
+      if (report.type_ == ReportType::Trade)
+        trades.push_back(report);
+    }
+  }
+
+  ASSERT_EQ(trades.size(), 1u);
+  ASSERT_EQ(trades[0].symbol_, 9u);
+  ASSERT_EQ(manager.GetOrderbook(7).Size(), 1u);
+  ASSERT_EQ(manager.GetOrderbook(8).Size(), 1u);
+  ASSERT_EQ(manager.GetOrderbook(9).Size(), 0u);
+}
+
+TEST(SessionSchedulerTests, PostsOnceWhenDue) {
+  SessionScheduler scheduler;
+  std::atomic<int> posts{0};
+  const auto target = scheduler.Register([&posts] { ++posts; });
+  scheduler.Start();
+
+  scheduler.Reschedule(target, std::chrono::floor<std::chrono::seconds>(
+                                   std::chrono::system_clock::now()));
+  const auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (posts.load() == 0 && std::chrono::steady_clock::now() < giveUp)
+    std::this_thread::yield();
+
+  // Posting clears the deadline, so nothing more until we reschedule
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  scheduler.Stop();
+  ASSERT_EQ(posts.load(), 1);
+}
+
+TEST(OrderbookTests, AddOrder_TradeSinkSeesEveryFill) {
+  Orderbook orderbook;
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Sell, 100, 5});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Sell, 101, 5});
+
+  std::vector<OrderId> filledAsks;
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Buy, 101, 10},
+                     [&filledAsks](const Trade &trade) {
+                       filledAsks.push_back(trade.GetAskTrade().orderId_);
+                     });
+
+  ASSERT_EQ(filledAsks, (std::vector<OrderId>{1, 2}));
+  ASSERT_EQ(orderbook.Size(), 0u);
+}
+
+TEST(OrderbookTests, ModifyOrder_QuantityDownKeepsPriority) {
+  Orderbook orderbook;
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Buy, 100, 10});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Buy, 100, 10});
+
+  orderbook.ModifyOrder(OrderModify{1, Side::Buy, 100, 4});
+
+  auto trades =
+      orderbook.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Sell, 100, 4});
+  ASSERT_EQ(trades.size(), 1u);
+  ASSERT_EQ(trades[0].GetBidTrade().orderId_, 1u);
+  ASSERT_EQ(orderbook.GetOrderInfos().GetBids()[0].quantity_, 10u);
+}
+
+TEST(OrderbookTests, ModifyOrder_QuantityUpLosesPriority) {
+  Orderbook orderbook;
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Buy, 100, 10});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Buy, 100, 10});
+
+  orderbook.ModifyOrder(OrderModify{1, Side::Buy, 100, 15});
+
+  auto trades =
+      orderbook.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Sell, 100, 4});
+  ASSERT_EQ(trades.size(), 1u);
+  ASSERT_EQ(trades[0].GetBidTrade().orderId_, 2u);
+  ASSERT_EQ(orderbook.GetOrderInfos().GetBids()[0].quantity_, 21u);
+}
+
+TEST(OrderbookTests, ApplyBatch_RunsCommandsInOrder) {
+  Orderbook orderbook;
+  std::vector<OrderPointer> orders{
+      std::make_shared<Order>(OrderType::GoodTillCancel, 1, Side::Sell, 100, 5),
+      std::make_shared<Order>(OrderType::GoodTillCancel, 2, Side::Sell, 101, 5)};
+  Trades trades;
+  orderbook.AddOrders(orders, trades);
+  ASSERT_TRUE(trades.empty());
+
+  const std::vector<OrderCommand> commands{
+      {CommandType::Cancel, {}, {}, {}, {}, 1},
+      {CommandType::Add, OrderType::GoodTillCancel, Side::Buy, 101, 8, 3},
+      {CommandType::Modify, {}, Side::Buy, 99, 3, 3},
+  };
+  orderbook.ApplyBatch(commands, trades);
+
+  // Order 1 is gone before 3 arrives, so 3 only trades with 2
+  ASSERT_EQ(trades.size(), 1u);
+  ASSERT_EQ(trades[0].GetAskTrade().orderId_, 2u);
+  ASSERT_EQ(orderbook.Size(), 1u);
+  ASSERT_EQ(orderbook.GetOrderInfos().GetBids()[0].price_, 99);
+}
+
+TEST(OrderbookTests, Fills_ReuseTheCallersBuffer) {
+  Orderbook orderbook;
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Sell, 100, 5});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Sell, 101, 5});
+
+  Fills fills;
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Buy, 101, 7},
+                     fills);
+  ASSERT_EQ(fills.size(), 2u);
+  ASSERT_EQ(fills[0].bidOrderId_, 3u);
+  ASSERT_EQ(fills[0].askOrderId_, 1u);
+  ASSERT_EQ(fills[0].askPrice_, 100);
+  ASSERT_EQ(fills[0].quantity_, 5u);
+  ASSERT_EQ(fills[1].askOrderId_, 2u);
+  ASSERT_EQ(fills[1].quantity_, 2u);
+
+  // Cleared, not freed
+  const auto *storage = fills.data();
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 4, Side::Buy, 90, 1},
+                     fills);
+  ASSERT_TRUE(fills.empty());
+  orderbook.ModifyOrder(OrderModify{4, Side::Buy, 101, 3}, fills);
+  ASSERT_EQ(fills.size(), 1u);
+  ASSERT_EQ(fills[0].bidOrderId_, 4u);
+  ASSERT_EQ(fills.data(), storage);
+}
+
+TEST(OrderbookTests, SelfTradePrevention_FollowsTheIncomingOrder) {
+  {
+    // CancelNewest: the incoming order goes, the resting one is untouched
+    Orderbook orderbook;
+    orderbook.AddOrder(Tagged(OrderType::GoodTillCancel, 1, Side::Sell, 100, 5,
+                              7, SelfTradePrevention::None));
+    ASSERT_TRUE(orderbook
+                    .AddOrder(Tagged(OrderType::GoodTillCancel, 2, Side::Buy,
+                                     100, 5, 7,
+                                     SelfTradePrevention::CancelNewest))
+                    .empty());
+    ASSERT_EQ(orderbook.Size(), 1u);
+    ASSERT_EQ(orderbook.GetBestAsk()->quantity_, 5u);
+
+    // Another account trades with it as usual
+    ASSERT_EQ(orderbook
+                  .AddOrder(Tagged(OrderType::FillAndKill, 3, Side::Buy, 100,
+                                   2, 8, SelfTradePrevention::CancelNewest))
+                  .size(),
+              1u);
+  }
+
+  {
+    // CancelOldest: our own resting order goes and matching carries on behind
+    // it, in the sweep as well as in the resting match
+    Orderbook orderbook;
+    orderbook.AddOrder(Tagged(OrderType::GoodTillCancel, 1, Side::Sell, 100, 5,
+                              7, SelfTradePrevention::None));
+    orderbook.AddOrder(Tagged(OrderType::GoodTillCancel, 2, Side::Sell, 100, 4,
+                              9, SelfTradePrevention::None));
+    const auto trades = orderbook.AddOrder(
+        Tagged(OrderType::FillAndKill, 3, Side::Buy, 100, 6, 7,
+               SelfTradePrevention::CancelOldest));
+    ASSERT_EQ(trades.size(), 1u);
+    ASSERT_EQ(trades[0].GetAskTrade().orderId_, 2u);
+    ASSERT_EQ(trades[0].GetAskTrade().quantity, 4u);
+    ASSERT_EQ(orderbook.Size(), 0u);
+
+    orderbook.AddOrder(Tagged(OrderType::GoodTillCancel, 4, Side::Buy, 99, 3,
+                              7, SelfTradePrevention::None));
+    orderbook.AddOrder(Tagged(OrderType::GoodTillCancel, 5, Side::Sell, 99, 3,
+                              7, SelfTradePrevention::CancelOldest));
+    ASSERT_EQ(orderbook.Size(), 1u);
+    ASSERT_FALSE(orderbook.GetBestBid());
+    ASSERT_EQ(orderbook.GetBestAsk()->price_, 99);
+  }
+
+  {
+    // DecrementBoth: both shrink by the overlap, with no trade reported
+    Orderbook orderbook;
+    orderbook.AddOrder(Tagged(OrderType::GoodTillCancel, 1, Side::Sell, 100, 5,
+                              7, SelfTradePrevention::None));
+    ASSERT_TRUE(orderbook
+                    .AddOrder(Tagged(OrderType::GoodTillCancel, 2, Side::Buy,
+                                     100, 3, 7,
+                                     SelfTradePrevention::DecrementBoth))
+                    .empty());
+    ASSERT_EQ(orderbook.Size(), 1u);
+    ASSERT_EQ(orderbook.GetBestAsk()->quantity_, 2u);
+
+    ASSERT_TRUE(orderbook
+                    .AddOrder(Tagged(OrderType::FillAndKill, 3, Side::Buy, 100,
+                                     4, 7, SelfTradePrevention::DecrementBoth))
+                    .empty());
+    ASSERT_EQ(orderbook.Size(), 0u);
+    ASSERT_FALSE(orderbook.GetBestAsk());
+  }
+}
+
+TEST(OrderbookTests, SelfTradePrevention_KeepsFillOrKillAllOrNothing) {
+  auto Book = [] {
+    auto orderbook = std::make_unique<Orderbook>();
+    orderbook->AddOrder(Tagged(OrderType::GoodTillCancel, 1, Side::Sell, 100,
+                               5, 8, SelfTradePrevention::None));
+    orderbook->AddOrder(Tagged(OrderType::GoodTillCancel, 2, Side::Sell, 101,
+                               5, 7, SelfTradePrevention::None));
+    orderbook->AddOrder(Tagged(OrderType::GoodTillCancel, 3, Side::Sell, 101,
+                               5, 9, SelfTradePrevention::None));
+    return orderbook;
+  };
+
+  // Our own 5 at 101 sits between the 5 at 100 and the other 5 at 101, so
+  // under CancelNewest or DecrementBoth only 5 could ever trade: killed whole
+  for (const auto mode :
+       {SelfTradePrevention::CancelNewest,
+        SelfTradePrevention::DecrementBoth}) {
+    const auto orderbook = Book();
+    ASSERT_TRUE(orderbook
+                    ->AddOrder(Tagged(OrderType::FillOrKill, 4, Side::Buy, 101,
+                                      10, 7, mode))
+                    .empty());
+    ASSERT_EQ(orderbook->Size(), 3u);
+    ASSERT_EQ(orderbook->GetBestAsk()->quantity_, 5u);
+
+    // Up to our own order there's enough, and it trades as usual
+    ASSERT_EQ(orderbook
+                  ->AddOrder(Tagged(OrderType::FillOrKill, 5, Side::Buy, 101, 5,
+                                    7, mode))
+                  .size(),
+              1u);
+    ASSERT_EQ(orderbook->Size(), 2u);
+  }
+
+  {
+    // CancelOldest cancels our own order on the way, so the other 10 count,
+    // but not the 5 of ours
+    const auto orderbook = Book();
+    ASSERT_TRUE(orderbook
+                    ->AddOrder(Tagged(OrderType::FillOrKill, 4, Side::Buy, 101,
+                                      11, 7, SelfTradePrevention::CancelOldest))
+                    .empty());
+    ASSERT_EQ(orderbook->Size(), 3u);
+
+    const auto trades = orderbook->AddOrder(Tagged(
+        OrderType::FillOrKill, 5, Side::Buy, 101, 10, 7,
+        SelfTradePrevention::CancelOldest));
+    ASSERT_EQ(trades.size(), 2u);
+    ASSERT_EQ(trades[1].GetAskTrade().orderId_, 3u);
+    ASSERT_EQ(orderbook->Size(), 0u);
+  }
+}
+
+TEST(OrderbookTests, TopOfBook_TracksTheTouch) {
+  OrderbookConfig config;
+  config.priceBandLevels_ = 64;
+  config.priceBandBase_ = 100;
+  Orderbook orderbook{config};
+  ASSERT_FALSE(orderbook.GetTopOfBook().bid_);
+  ASSERT_FALSE(orderbook.GetBestAsk());
+
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Buy, 99, 10});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Buy, 99, 5});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Buy, 98, 7});
+  // Outside the band on the ask side, so the touch comes from the overflow
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 4, Side::Sell, 500, 3});
+
+  const auto top = orderbook.GetTopOfBook();
+  ASSERT_EQ(top.bid_->price_, 99);
+  ASSERT_EQ(top.bid_->quantity_, 15u);
+  ASSERT_EQ(top.bid_->count_, 2u);
+  ASSERT_EQ(top.ask_->price_, 500);
+  ASSERT_EQ(top.ask_->count_, 1u);
+
+  // Back in the band, ahead of the overflow level
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 5, Side::Sell, 101, 4});
+  ASSERT_EQ(orderbook.GetBestAsk()->price_, 101);
+
+  orderbook.AddOrder(Order{OrderType::FillAndKill, 6, Side::Sell, 99, 12});
+  const auto bid = orderbook.GetBestBid();
+  ASSERT_EQ(bid->price_, 99);
+  ASSERT_EQ(bid->quantity_, 3u);
+  ASSERT_EQ(bid->count_, 1u);
+
+  orderbook.CancelOrder(2);
+  ASSERT_EQ(orderbook.GetBestBid()->price_, 98);
+}
+
+TEST(OrderbookTests, LevelUpdates_FollowEveryLevelChange) {
+  OrderbookConfig config;
+  config.threadingMode_ = ThreadingMode::SingleWriter;
+  config.levelUpdateCapacity_ = 4;
+  Orderbook orderbook{config};
+
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Sell, 100, 10});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Sell, 100, 5});
+  // Takes 4 from order 1, and leaves nothing of itself
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Buy, 100, 4});
+
+  std::vector<LevelUpdate> updates;
+  LevelUpdate update;
+  while (orderbook.TryPollLevelUpdate(update))
+    updates.push_back(update);
+
+  ASSERT_EQ(updates.size(), 4u);
+  for (std::size_t index = 0; index < updates.size(); ++index)
+    ASSERT_EQ(updates[index].sequence_, index + 1);
+  ASSERT_EQ(updates[1].quantity_, 15u);
+  ASSERT_EQ(updates[1].count_, 2u);
+  // The bid arrives and is filled straight away...
+  ASSERT_EQ(updates[2].side_, Side::Buy);
+  ASSERT_EQ(updates[2].count_, 1u);
+  ASSERT_EQ(updates[3].side_, Side::Buy);
+  ASSERT_EQ(updates[3].count_, 0u);
+
+  // ...and the ask side's change didn't fit, which shows up as a gap
+  orderbook.CancelOrder(2);
+  ASSERT_TRUE(orderbook.TryPollLevelUpdate(update));
+  ASSERT_EQ(update.sequence_, 6u);
+  ASSERT_EQ(update.quantity_, 6u);
+  ASSERT_EQ(orderbook.GetOrderInfos().GetSequence(), 6u);
+
+  // A modify that changes nothing isn't a level change either
+  orderbook.ModifyOrder(OrderModify{1, Side::Sell, 100, 6});
+  ASSERT_FALSE(orderbook.TryPollLevelUpdate(update));
+  ASSERT_EQ(orderbook.GetOrderInfos().GetSequence(), 6u);
+  orderbook.ModifyOrder(OrderModify{1, Side::Sell, 100, 5});
+  ASSERT_TRUE(orderbook.TryPollLevelUpdate(update));
+  ASSERT_EQ(update.sequence_, 7u);
+  ASSERT_EQ(update.quantity_, 5u);
+}
+
+TEST(OrderbookTests, ReadSnapshot_IsConsistentWhileMatching) {
+  OrderbookConfig config;
+  config.snapshotDepth_ = BookSnapshot::MaxDepth;
+  Orderbook orderbook{config};
+
+  std::atomic<bool> done{false};
+  std::thread reader{[&] {
+    std::uint64_t lastSequence{};
+    while (!done.load()) {
+      const auto snapshot = orderbook.ReadSnapshot();
+      // Every order sits on its own level, with a quantity equal to its price
+      EXPECT_EQ(snapshot.orders_, snapshot.bidDepth_);
+      for (std::uint32_t level = 0; level < snapshot.bidDepth_; ++level)
+        EXPECT_EQ(snapshot.bids_[level].quantity_,
+                  static_cast<Quantity>(snapshot.bids_[level].price_));
+      EXPECT_GE(snapshot.sequence_, lastSequence);
+      lastSequence = snapshot.sequence_;
+    }
+  }};
+
+  for (int round = 0; round < 200; ++round) {
+    for (Price price = 1; price <= 10; ++price)
+      orderbook.AddOrder(Order{OrderType::GoodTillCancel,
+                               static_cast<OrderId>(price), Side::Buy, price,
+                               static_cast<Quantity>(price)});
+    for (OrderId orderId = 1; orderId <= 10; ++orderId)
+      orderbook.CancelOrder(orderId);
+  }
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Buy, 7, 7});
+
+  done = true;
+  reader.join();
+
+  const auto snapshot = orderbook.ReadSnapshot();
+  ASSERT_EQ(snapshot.bidDepth_, 1u);
+  ASSERT_EQ(snapshot.bids_[0].price_, 7);
+  ASSERT_EQ(snapshot.askDepth_, 0u);
+}
+
+TEST(OrderbookTests, GetOrderInfos_DepthAndAggregates) {
+  Orderbook orderbook;
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Sell, 101, 5});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Sell, 101, 7});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Sell, 102, 4});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 4, Side::Sell, 103, 9});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 5, Side::Buy, 101, 3});
+  orderbook.CancelOrder(3);
+
+  const auto top = orderbook.GetOrderInfos(1);
+  ASSERT_EQ(top.GetAsks().size(), 1u);
+  ASSERT_EQ(top.GetAsks()[0].price_, 101);
+  ASSERT_EQ(top.GetAsks()[0].quantity_, 9u);
+  ASSERT_TRUE(top.GetBids().empty());
+
+  const auto all = orderbook.GetOrderInfos();
+  ASSERT_EQ(all.GetAsks().size(), 2u);
+  ASSERT_EQ(all.GetAsks()[1].price_, 103);
+  ASSERT_EQ(all.GetAsks()[1].quantity_, 9u);
+}
+
+TEST(OrderbookTests, ExpireOrders_OnlyTouchesDueOrdersInChunks) {
+  using namespace std::chrono;
+
+  const auto now = floor<seconds>(system_clock::now());
+
+  // Put the close half a day away so the test never straddles it
+  const auto now_c = system_clock::to_time_t(now);
+  std::tm now_parts;
+  localtime_r(&now_c, &now_parts);
+
+  OrderbookConfig config;
+  config.threadingMode_ = ThreadingMode::SingleWriter;
+  config.expiryChunk_ = 2;
+  config.sessionClose_ =
+      minutes((now_parts.tm_hour * 60 + now_parts.tm_min + 12 * 60) % (24 * 60));
+  Orderbook orderbook{config};
+
+  for (OrderId orderId = 1; orderId <= 3; ++orderId)
+    orderbook.AddOrder(
+        Order{OrderType::GoodForDay, orderId, Side::Buy, 100, 10});
+  orderbook.AddOrder(Order{OrderType::GoodTillDate, 4, Side::Buy, 99, 10,
+                           now + minutes(1)});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 5, Side::Sell, 105, 10});
+
+  ASSERT_EQ(orderbook.NextExpiry(), now + minutes(1));
+
+  // Nothing is due yet
+  ASSERT_EQ(orderbook.ExpireOrders(now), 0u);
+
+  // The GoodTillDate order comes due on its own
+  ASSERT_EQ(orderbook.ExpireOrders(now + minutes(1)), 1u);
+  ASSERT_EQ(orderbook.Size(), 4u);
+
+  // At the session close the GoodForDay orders go, two per call
+  const auto close = orderbook.NextExpiry();
+  ASSERT_EQ(orderbook.ExpireOrders(close), 2u);
+  ASSERT_EQ(orderbook.ExpireOrders(close), 1u);
+  ASSERT_EQ(orderbook.ExpireOrders(close), 0u);
+  ASSERT_EQ(orderbook.Size(), 1u);
+  ASSERT_GT(orderbook.NextExpiry(), close);
+}
+
+TEST(OrderbookTests, LockedBook_ExpiresGoodTillDateOnItsOwn) {
+  using namespace std::chrono;
+
+  // The session close is hours away, so the scheduler is asleep until the
+  // add tells it about something sooner
+  Orderbook orderbook;
+  const auto expiry = floor<seconds>(system_clock::now()) + seconds(1);
+  orderbook.AddOrder(Order{OrderType::GoodTillDate, 1, Side::Buy, 100, 10,
+                           expiry});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Buy, 99, 10});
+
+  const auto deadline = steady_clock::now() + seconds(5);
+  while (orderbook.Size() != 1 && steady_clock::now() < deadline)
+    std::this_thread::sleep_for(milliseconds(10));
+
+  ASSERT_EQ(orderbook.Size(), 1u);
+  ASSERT_GE(system_clock::now(), expiry);
+}
+
+TEST(OrderbookTests, Journal_ReplayRebuildsTheBook) {
+  const auto path =
+      (std::filesystem::temp_directory_path() / "orderbook_journal_test.bin")
+          .string();
+
+  OrderbookLevelInfos original{{}, {}};
+  std::size_t originalTrades{};
+  {
+    JournalWriter journal{path};
+    OrderbookConfig config;
+    config.threadingMode_ = ThreadingMode::SingleWriter;
+    config.journal_ = &journal;
+    Orderbook orderbook{config};
+
+    auto onTrade = [&originalTrades](const Trade &) { ++originalTrades; };
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Buy, 100, 10},
+                       onTrade);
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Buy, 99, 10},
+                       onTrade);
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Sell, 101, 5},
+                       onTrade);
+    orderbook.ModifyOrder(OrderModify{3, Side::Sell, 100, 15}, onTrade);
+    orderbook.CancelOrder(2);
+    // Rejected as a duplicate, so it never reaches the journal
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Buy, 90, 10},
+                       onTrade);
+
+    original = orderbook.GetOrderInfos();
+  }
+
+  // The five commands, after the session close the book started with
+  const JournalReader journal{path};
+  ASSERT_EQ(journal.Records().size(), 6u);
+  ASSERT_EQ(journal.Records()[0].type_, JournalRecordType::SessionClose);
+
+  OrderbookConfig config;
+  config.threadingMode_ = ThreadingMode::SingleWriter;
+  Orderbook replayed{config};
+  std::size_t replayedTrades{};
+  ReplayJournal(replayed, journal.Records(),
+                [&replayedTrades](const Trade &) { ++replayedTrades; });
+
+  ASSERT_EQ(replayedTrades, originalTrades);
+  const auto infos = replayed.GetOrderInfos();
+  ASSERT_EQ(infos.GetBids().size(), original.GetBids().size());
+  ASSERT_EQ(infos.GetAsks().size(), original.GetAsks().size());
+  ASSERT_EQ(infos.GetAsks()[0].price_, 100);
+  ASSERT_EQ(infos.GetAsks()[0].quantity_, original.GetAsks()[0].quantity_);
+
+  std::filesystem::remove(path);
+}
+
+TEST(OrderbookTests, Journal_ReplayKeepsGoodForDayExpiries) {
+  using namespace std::chrono;
+
+  const auto path =
+      (std::filesystem::temp_directory_path() / "orderbook_gfd_journal_test.bin")
+          .string();
+
+  const auto now_c = system_clock::to_time_t(system_clock::now());
+  std::tm now_parts;
+  localtime_r(&now_c, &now_parts);
+  auto CloseIn = [&](int hours) {
+    return minutes((now_parts.tm_hour * 60 + now_parts.tm_min + hours * 60) %
+                   (24 * 60));
+  };
+
+  OrderbookConfig config;
+  config.threadingMode_ = ThreadingMode::SingleWriter;
+
+  std::vector<CheckpointRecord> original;
+  {
+    JournalWriter journal{path};
+    auto journaled = config;
+    journaled.sessionClose_ = CloseIn(12);
+    journaled.journal_ = &journal;
+    Orderbook orderbook{journaled};
+
+    // One GoodForDay order expires at the close, and the next is given the
+    // following day's
+    orderbook.AddOrder(Order{OrderType::GoodForDay, 1, Side::Buy, 100, 10});
+    const auto close = orderbook.NextExpiry();
+    ASSERT_EQ(orderbook.ExpireOrders(close), 1u);
+    orderbook.AddOrder(Order{OrderType::GoodForDay, 2, Side::Buy, 99, 10});
+    original = orderbook.Checkpoint().records_;
+    ASSERT_GT(original[0].expiry_, close.time_since_epoch().count());
+  }
+
+  // As if replayed on another day: this book's own close would come after
+  // the recorded expiry pass, and order 1 would outlive it
+  const JournalReader journal{path};
+  auto replaying = config;
+  replaying.sessionClose_ = CloseIn(18);
+  Orderbook replayed{replaying};
+  ReplayJournal(replayed, journal.Records(), [](const Trade &) {});
+
+  const auto restored = replayed.Checkpoint().records_;
+  ASSERT_EQ(restored.size(), 1u);
+  ASSERT_EQ(restored[0].orderId_, 2u);
+  ASSERT_EQ(restored[0].expiry_, original[0].expiry_);
+
+  std::filesystem::remove(path);
+}
+
+TEST(OrderbookTests, Journal_ReplayExpiresWhatEachPassDid) {
+  const auto path = (std::filesystem::temp_directory_path() /
+                     "orderbook_chunked_journal_test.bin")
+                        .string();
+
+  OrderbookConfig config;
+  config.threadingMode_ = ThreadingMode::SingleWriter;
+
+  std::size_t originalTrades{};
+  std::vector<CheckpointRecord> original;
+  {
+    JournalWriter journal{path};
+    auto journaled = config;
+    journaled.expiryChunk_ = 2;
+    journaled.journal_ = &journal;
+    Orderbook orderbook{journaled};
+
+    auto onTrade = [&originalTrades](const Trade &) { ++originalTrades; };
+    for (OrderId orderId = 1; orderId <= 3; ++orderId)
+      orderbook.AddOrder(
+          Order{OrderType::GoodForDay, orderId, Side::Buy, 100, 10}, onTrade);
+
+    // The first chunk takes two, and a sell gets in before the last one goes
+    const auto close = orderbook.NextExpiry();
+    ASSERT_EQ(orderbook.ExpireOrders(close), 2u);
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 4, Side::Sell, 100, 4},
+                       onTrade);
+    ASSERT_EQ(orderbook.ExpireOrders(close), 1u);
+    original = orderbook.Checkpoint().records_;
+  }
+  ASSERT_EQ(originalTrades, 1u);
+
+  // Chunks of 1024 would have expired all three at once
+  const JournalReader journal{path};
+  Orderbook replayed{config};
+  std::size_t replayedTrades{};
+  ReplayJournal(replayed, journal.Records(),
+                [&replayedTrades](const Trade &) { ++replayedTrades; });
+
+  ASSERT_EQ(replayedTrades, originalTrades);
+  const auto restored = replayed.Checkpoint().records_;
+  ASSERT_EQ(restored.size(), original.size());
+  ASSERT_EQ(restored.size(), 0u);
+
+  std::filesystem::remove(path);
+}
+
+TEST(OrderbookTests, Config_ReservesEverythingUpFront) {
+  // Counts what the book asks of its memory resource once it's built
+  struct CountingResource : std::pmr::memory_resource {
+    std::size_t allocations_{};
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+      ++allocations_;
+      return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void *memory, std::size_t bytes,
+                       std::size_t alignment) override {
+      std::pmr::new_delete_resource()->deallocate(memory, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource &other) const
+        noexcept override {
+      return this == &other;
+    }
+  } counting;
+
+  OrderbookConfig config;
+  config.threadingMode_ = ThreadingMode::SingleWriter;
+  config.priceBandLevels_ = 16;
+  config.priceBandBase_ = 100;
+  config.tickSize_ = 5;
+  config.expectedOrders_ = 2000;
+  config.expectedLevels_ = 64;
+  config.expectedExpiries_ = 256;
+  const auto now = std::chrono::floor<std::chrono::seconds>(
+      std::chrono::system_clock::now());
+
+  auto *previous = std::pmr::set_default_resource(&counting);
+  {
+    Orderbook orderbook{config};
+    counting.allocations_ = 0;
+
+    // Off the grid, so ignored
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Buy, 103, 1});
+    ASSERT_EQ(orderbook.Size(), 0u);
+
+    // 16 slots of 5 ticks cover 100..175; the rest is overflow. Every tenth
+    // order has a deadline of its own.
+    const auto sink = [](const Trade &) {};
+    for (OrderId id = 1; id <= 2000; ++id) {
+      const auto level = static_cast<Price>(id % 48);
+      const auto type =
+          id % 10 == 0 ? OrderType::GoodTillDate : OrderType::GoodTillCancel;
+      orderbook.AddOrder(Order{type, id, Side::Buy,
+                               static_cast<Price>(100 + level * 5), 1,
+                               now + std::chrono::hours{1} +
+                                   std::chrono::seconds{id}},
+                         sink);
+    }
+    ASSERT_EQ(orderbook.Size(), 2000u);
+    ASSERT_EQ(orderbook.GetBestBid()->price_, 335);
+    ASSERT_EQ(counting.allocations_, 0u);
+
+    orderbook.AddOrder(
+        Order{OrderType::FillAndKill, 2001, Side::Sell, 150, 2000}, sink);
+    ASSERT_EQ(orderbook.GetBestBid()->price_, 145);
+  }
+  std::pmr::set_default_resource(previous);
+
+  // Huge pages may well not be configured here; either way the book works
+  config.hugePages_ = true;
+  config.expectedOrders_ = 100000;
+  Orderbook orderbook{config};
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Sell, 110, 3});
+  ASSERT_EQ(
+      orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Buy, 110, 1})
+          .size(),
+      1u);
+  ASSERT_EQ(orderbook.GetBestAsk()->quantity_, 2u);
+}
+
+TEST(AuctionTests, ClearingPriceMaximisesVolume) {
+  const LevelInfos bids{{102, 10}, {101, 20}, {100, 30}, {90, 50}};
+  const LevelInfos asks{{99, 15}, {100, 25}, {101, 30}, {110, 5}};
+  const auto result = FindClearingPrice(bids, asks);
+  ASSERT_EQ(result.price_, 100);
+  ASSERT_EQ(result.volume_, 40u);
+  ASSERT_EQ(result.imbalance_, 20u);
+  ASSERT_EQ(result.imbalanceSide_, Side::Buy);
+
+  // A tie with nothing left over either way goes to the lower price
+  const LevelInfos bid{{101, 10}};
+  const LevelInfos ask{{100, 10}};
+  ASSERT_EQ(FindClearingPrice(bid, ask).price_, 100);
+
+  ASSERT_EQ(FindClearingPrice(ask, bid).volume_, 0u);
+  ASSERT_EQ(FindClearingPrice({}, asks).volume_, 0u);
+}
+
+TEST(OrderbookTests, Auction_UncrossesAtOnePrice) {
+  Orderbook orderbook;
+  orderbook.BeginAuction();
+  ASSERT_TRUE(orderbook.InAuction());
+
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Sell, 99, 15});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Sell, 100, 25});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Sell, 101, 30});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 4, Side::Buy, 100, 20});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 5, Side::Buy, 102, 10});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 6, Side::Buy, 101, 20});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 7, Side::Buy, 100, 10});
+  // Nothing to trade against until the uncross
+  orderbook.AddOrder(Order{OrderType::FillAndKill, 8, Side::Buy, 105, 10});
+  ASSERT_EQ(orderbook.Size(), 7u);
+  ASSERT_EQ(orderbook.GetIndicativeUncross().volume_, 40u);
+
+  Trades trades;
+  const auto result = orderbook.Uncross(
+      [&trades](const Trade &trade) { trades.push_back(trade); });
+  ASSERT_FALSE(orderbook.InAuction());
+  ASSERT_EQ(result.price_, 100);
+  ASSERT_EQ(result.volume_, 40u);
+
+  Quantity traded{};
+  for (const auto &trade : trades) {
+    ASSERT_EQ(trade.GetBidTrade().price_, 100);
+    ASSERT_EQ(trade.GetAskTrade().price_, 100);
+    traded += trade.GetBidTrade().quantity;
+  }
+  ASSERT_EQ(traded, 40u);
+  // Best bids first: 102 and 101 fill, then the older order at 100
+  ASSERT_EQ(trades.front().GetBidTrade().orderId_, 5u);
+  ASSERT_EQ(trades.back().GetBidTrade().orderId_, 4u);
+
+  const auto top = orderbook.GetTopOfBook();
+  ASSERT_EQ(top.bid_->price_, 100);
+  ASSERT_EQ(top.bid_->quantity_, 20u);
+  ASSERT_EQ(top.ask_->price_, 101);
+
+  // Back to continuous matching
+  ASSERT_EQ(
+      orderbook.AddOrder(Order{OrderType::GoodTillCancel, 9, Side::Sell, 100, 5})
+          .size(),
+      1u);
+}
+
+TEST(OrderbookTests, Auction_UncrossesBooksInParallel) {
+  std::vector<std::unique_ptr<Orderbook>> books;
+  std::vector<Orderbook *> raw;
+  for (Price offset = 0; offset < 8; ++offset) {
+    books.push_back(std::make_unique<Orderbook>());
+    books.back()->BeginAuction();
+    books.back()->AddOrder(
+        Order{OrderType::GoodTillCancel, 1, Side::Sell, 100 + offset, 5});
+    books.back()->AddOrder(
+        Order{OrderType::GoodTillCancel, 2, Side::Buy, 100 + offset, 3});
+    raw.push_back(books.back().get());
+  }
+
+  std::atomic<std::size_t> trades{0};
+  const auto results =
+      UncrossInParallel(raw, 3, [&trades](std::size_t, const Trade &) {
+        trades.fetch_add(1, std::memory_order_relaxed);
+      });
+  ASSERT_EQ(results.size(), 8u);
+  ASSERT_EQ(trades.load(), 8u);
+  for (Price offset = 0; offset < 8; ++offset) {
+    ASSERT_EQ(results[offset].price_, 100 + offset);
+    ASSERT_EQ(results[offset].volume_, 3u);
+    ASSERT_EQ(books[offset]->Size(), 1u);
+  }
+}
+
+TEST(OrderbookTests, Checkpoint_RestoreRebuildsQueuesWithoutMatching) {
+  const auto path =
+      (std::filesystem::temp_directory_path() / "orderbook_checkpoint_test.bin")
+          .string();
+  const auto expiry = std::chrono::floor<std::chrono::seconds>(
+      std::chrono::system_clock::now() + std::chrono::hours{24});
+
+  Orderbook original;
+  original.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Buy, 100, 10});
+  original.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Buy, 100, 20});
+  original.AddOrder(Order{OrderType::GoodForDay, 3, Side::Buy, 98, 7});
+  original.AddOrder(Order{OrderType::GoodTillCancel, 4, Side::Sell, 101, 10});
+  // Well outside the price band
+  original.AddOrder(
+      Order{OrderType::GoodTillDate, 5, Side::Sell, 50'000, 3, expiry});
+  // Leaves order 1 partly filled at the front of its level
+  original.AddOrder(Order{OrderType::FillAndKill, 6, Side::Sell, 100, 4});
+
+  WriteCheckpoint(path, original.Checkpoint());
+  const CheckpointReader checkpoint{path};
+  ASSERT_EQ(checkpoint.Records().size(), 5u);
+
+  Orderbook restored;
+  restored.Restore(checkpoint.Records());
+
+  ASSERT_EQ(restored.Size(), original.Size());
+  ASSERT_EQ(restored.NextExpiry(), original.NextExpiry());
+  const auto expected = original.GetOrderInfos();
+  const auto infos = restored.GetOrderInfos();
+  ASSERT_EQ(infos.GetBids().size(), expected.GetBids().size());
+  ASSERT_EQ(infos.GetAsks().size(), expected.GetAsks().size());
+  for (std::size_t level = 0; level < infos.GetBids().size(); ++level) {
+    ASSERT_EQ(infos.GetBids()[level].price_, expected.GetBids()[level].price_);
+    ASSERT_EQ(infos.GetBids()[level].quantity_,
+              expected.GetBids()[level].quantity_);
+  }
+
+  // Time priority survives: the rest of order 1 goes before order 2
+  const auto trades =
+      restored.AddOrder(Order{OrderType::FillAndKill, 7, Side::Sell, 100, 8});
+  ASSERT_EQ(trades.size(), 2u);
+  ASSERT_EQ(trades[0].GetBidTrade().orderId_, 1u);
+  ASSERT_EQ(trades[0].GetBidTrade().quantity, 6u);
+  ASSERT_EQ(trades[1].GetBidTrade().orderId_, 2u);
+
+  // Only into an empty book, and a bad checkpoint leaves it that way
+  ASSERT_THROW(restored.Restore(checkpoint.Records()), std::logic_error);
+  std::vector<CheckpointRecord> duplicated{checkpoint.Records().begin(),
+                                           checkpoint.Records().end()};
+  duplicated.push_back(duplicated.front());
+  Orderbook rejected;
+  ASSERT_THROW(rejected.Restore(duplicated), std::logic_error);
+  ASSERT_EQ(rejected.Size(), 0u);
+  ASSERT_TRUE(rejected.GetOrderInfos().GetBids().empty());
+
+  // Nor is a record whose enums are out of range
+  for (const auto field :
+       {&CheckpointRecord::side_, &CheckpointRecord::orderType_,
+        &CheckpointRecord::selfTradePrevention_}) {
+    std::vector<CheckpointRecord> corrupt{checkpoint.Records().begin(),
+                                          checkpoint.Records().end()};
+    corrupt.back().*field = 9;
+    ASSERT_THROW(rejected.Restore(corrupt), std::logic_error);
+    ASSERT_EQ(rejected.Size(), 0u);
+  }
+
+  std::filesystem::remove(path);
+}
+
+TEST(OrderbookTests, Checkpoint_RestoresTheCallPhase) {
+  const auto path = (std::filesystem::temp_directory_path() /
+                     "orderbook_auction_checkpoint_test.bin")
+                        .string();
+
+  // Crossed, as a book in its call phase is allowed to be
+  Orderbook original;
+  original.BeginAuction();
+  original.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Buy, 102, 10});
+  original.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Sell, 100, 6});
+
+  WriteCheckpoint(path, original.Checkpoint());
+  const CheckpointReader checkpoint{path};
+  ASSERT_TRUE(checkpoint.InAuction());
+
+  Orderbook restored;
+  restored.Restore(checkpoint.Records(), checkpoint.InAuction());
+  ASSERT_TRUE(restored.InAuction());
+  ASSERT_EQ(restored.Size(), 2u);
+
+  // Still queueing rather than matching, and uncrosses as the original would
+  ASSERT_TRUE(
+      restored.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Sell, 101, 2})
+          .empty());
+  original.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Sell, 101, 2});
+  const auto expected = original.Uncross([](const Trade &) {});
+  const auto result = restored.Uncross([](const Trade &) {});
+  ASSERT_EQ(result.price_, expected.price_);
+  ASSERT_EQ(result.volume_, 8u);
+
+  // The same records outside an auction are a crossed book
+  Orderbook continuous;
+  ASSERT_THROW(continuous.Restore(checkpoint.Records()), std::logic_error);
+
+  std::filesystem::remove(path);
+}
+
+TEST(OrderEntryTests, DecodesFramesStraightIntoTheBook) {
+  std::vector<std::byte> wire(256);
+  std::size_t size{};
+  auto Append = [&](std::size_t written) {
+    ASSERT_NE(written, 0u);
+    size += written;
+  };
+  auto Rest = [&] { return std::span{wire}.subspan(size); };
+
+  Order gtd{OrderType::GoodTillDate, 1, Side::Sell, 101, 10,
+            ExpiryTime{std::chrono::seconds{4'000'000'000}}};
+  gtd.SetAccount(7, SelfTradePrevention::CancelOldest);
+  Append(EncodeEnterOrder(Rest(), gtd));
+  Append(EncodeEnterOrder(
+      Rest(), Order{OrderType::GoodTillCancel, 2, Side::Buy, 99, 4}));
+  Append(EncodeReplaceOrder(Rest(), OrderModify{2, Side::Buy, 101, 6}));
+  Append(EncodeCancelOrder(Rest(), 1));
+  ASSERT_EQ(EncodeCancelOrder(std::span{wire}.first(3), 1), 0u);
+
+  // Every field survives the trip
+  std::vector<OrderCommand> commands;
+  ASSERT_EQ(DecodeOrderEntry(std::span{wire}.first(size),
+                             [&](const OrderCommand &command) {
+                               commands.push_back(command);
+                             }),
+            size);
+  ASSERT_EQ(commands.size(), 4u);
+  const auto decoded = commands[0].ToOrder();
+  ASSERT_EQ(decoded.GetOrderType(), OrderType::GoodTillDate);
+  ASSERT_EQ(decoded.GetSide(), Side::Sell);
+  ASSERT_EQ(decoded.GetPrice(), 101);
+  ASSERT_EQ(decoded.GetInitialQuantity(), 10u);
+  ASSERT_EQ(decoded.GetAccount(), 7u);
+  ASSERT_EQ(decoded.GetSelfTradePrevention(), SelfTradePrevention::CancelOldest);
+  ASSERT_EQ(decoded.GetExpiry(), gtd.GetExpiry());
+  ASSERT_EQ(commands[2].type_, CommandType::Modify);
+  ASSERT_EQ(commands[3].type_, CommandType::Cancel);
+
+  // A receive that ends mid-frame leaves that frame for the next one
+  Orderbook orderbook;
+  Trades trades;
+  auto Collect = [&trades](const Trade &trade) { trades.push_back(trade); };
+  const auto first = ApplyOrderEntry(orderbook, std::span{wire}.first(40),
+                                     Collect);
+  ASSERT_EQ(first, 30u);
+  ASSERT_EQ(orderbook.Size(), 1u);
+  ASSERT_EQ(ApplyOrderEntry(orderbook,
+                            std::span{wire}.subspan(first, size - first),
+                            Collect),
+            size - first);
+  ASSERT_EQ(trades.size(), 1u);
+  ASSERT_EQ(trades[0].GetBidTrade().orderId_, 2u);
+  ASSERT_EQ(trades[0].GetBidTrade().quantity, 6u);
+  ASSERT_EQ(orderbook.Size(), 0u);
+
+  // Anything before a bad frame is still applied
+  size = 0;
+  Append(EncodeEnterOrder(
+      Rest(), Order{OrderType::GoodTillCancel, 3, Side::Buy, 99, 4}));
+  Append(EncodeCancelOrder(Rest(), 3));
+  wire[size - CancelOrderSize] = std::byte{'?'};
+  try {
+    ApplyOrderEntry(orderbook, std::span{wire}.first(size), Collect);
+    FAIL() << "the bad frame should have been rejected";
+  } catch (const OrderEntryError &error) {
+    // Which is where the caller picks up from
+    ASSERT_EQ(error.GetOffset(), OrderEntryHeaderSize + EnterOrderSize);
+  }
+  ASSERT_EQ(orderbook.Size(), 1u);
+}
+
+TEST(OrderIndexTests, MatchesUnorderedMapUnderChurn) {
+  OrderIndex index;
+  std::unordered_map<OrderId, OrderHandle> reference;
+  std::mt19937_64 random{7};
+  std::uniform_int_distribution<OrderId> orderId{1, 5'000};
+
+  for (OrderHandle step = 0; step < 100'000; ++step) {
+    const auto id = orderId(random);
+    if (random() % 3 == 0) {
+      const auto expected = reference.contains(id) ? reference[id]
+                                                   : OrderPool::InvalidHandle;
+      ASSERT_EQ(index.Erase(id), expected);
+      reference.erase(id);
+    } else {
+      ASSERT_EQ(index.Insert(id, step), reference.emplace(id, step).second);
+    }
+    ASSERT_EQ(index.Size(), reference.size());
+  }
+
+  for (OrderId id = 1; id <= 5'000; ++id)
+    ASSERT_EQ(index.Find(id), reference.contains(id) ? reference[id]
+                                                     : OrderPool::InvalidHandle);
+}
+
+TEST(LevelKernelsTests, AgreeWithScalar) {
+  std::mt19937 random{42};
+  std::uniform_int_distribution<Quantity> quantity{0, 1'000'000};
+
+  // Odd sizes so every kernel has a tail to finish off
+  for (std::size_t size : {0u, 3u, 17u, 1000u, 1029u}) {
+    std::vector<Quantity> quantities(size);
+    for (auto &level : quantities)
+      level = random() % 4 == 0 ? 0 : quantity(random);
+
+    ASSERT_EQ(SumQuantities(quantities), SumQuantitiesScalar(quantities));
+
+    std::vector<std::uint64_t> sums(size), expected(size);
+    PrefixSums(quantities, sums);
+    PrefixSumsScalar(quantities, expected);
+    ASSERT_EQ(sums, expected);
+
+    const auto total = SumQuantitiesScalar(quantities);
+    for (std::uint64_t target : {std::uint64_t{1}, total / 3, total, total + 1}) {
+      const auto search = FindCumulative(quantities, target);
+      const auto reference = FindCumulativeScalar(quantities, target);
+      ASSERT_EQ(search.index_, reference.index_);
+      ASSERT_EQ(search.total_, reference.total_);
+    }
+  }
+}
+
+TEST(InstrumentationTests, HistogramPercentilesStayWithinABucket) {
+  for (std::uint64_t value = 0; value < 100'000; value += 7)
+    ASSERT_LE(HistogramBuckets::LowerBound(HistogramBuckets::BucketFor(value)),
+              value);
+
+  LatencyHistogram histogram;
+  for (std::uint64_t value = 1; value <= 1000; ++value)
+    histogram.Record(value);
+
+  const auto snapshot = histogram.Snapshot();
+  ASSERT_EQ(snapshot.count_, 1000);
+  ASSERT_EQ(snapshot.max_, 1000);
+  // Log-linear buckets are within 12.5% of the true value
+  ASSERT_NEAR(snapshot.Percentile(0.5), 500, 500 / 8);
+  ASSERT_NEAR(snapshot.Percentile(0.99), 990, 990 / 8);
+  ASSERT_EQ(snapshot.Percentile(1.0), 1000);
+}
+
+#ifdef ORDERBOOK_ENABLE_INSTRUMENTATION
+TEST(InstrumentationTests, CountsWhatTheBookDid) {
+  Orderbook orderbook;
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Sell, 100, 10});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Sell, 101, 10});
+  orderbook.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Buy, 101, 15});
+  orderbook.CancelOrder(2);
+
+  const auto stats = orderbook.GetInstrumentation();
+  ASSERT_EQ(stats.Get(Counter::OrdersAdded), 3);
+  ASSERT_EQ(stats.Get(Counter::Trades), 2);
+  ASSERT_EQ(stats.Get(Counter::OrdersFilled), 2);
+  ASSERT_EQ(stats.Get(Counter::OrdersCancelled), 1);
+  ASSERT_EQ(stats.Get(Stage::Lookup).count_, 3);
+  ASSERT_EQ(stats.Get(Stage::Match).count_, 3);
+  ASSERT_EQ(stats.tradesPerAdd_.max_, 2);
+}
+#endif
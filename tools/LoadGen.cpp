@@ -0,0 +1,315 @@
+#include "../Orderbook.hpp"
+#include "../Sequencer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Synthetic order flow against one book from several threads at once, to see
+// how throughput scales with producers and how much of it the lock eats.
+//
+//   orderbook_loadgen [--threads 1,2,4,8] [--ops 200000] [--seed 42]
+//                     [--sequencer]
+//
+// Each producer thread replays its own pre-generated stream (so generating
+// it isn't timed) through the public Orderbook API, or with --sequencer
+// through a Sequencer's rings instead. Streams are seeded from --seed and the
+// thread's index, so a given run is the same flow every time; only the
+// interleaving between threads varies.
+//
+// Lock wait and contention figures need a build with
+// -DORDERBOOK_ENABLE_INSTRUMENTATION=ON.
+
+namespace {
+
+struct Options {
+  std::vector<std::size_t> threads_{1, 2, 4, 8};
+  std::size_t ops_{200'000};
+  std::uint64_t seed_{42};
+  bool sequencer_{false};
+};
+
+/**
+ * Prices random-walk around a mid, and most orders land within a few ticks
+ * of it. Adds are a mix of every type that fits in an OrderCommand (no
+ * GoodTillDate, which needs an expiry of its own); cancels and modifies pick
+ * one of this thread's earlier orders, which may well have traded already.
+ */
+class FlowGenerator {
+private:
+  static constexpr Price StartMid = 10'000;
+
+  std::mt19937_64 random_;
+  Price mid_{StartMid};
+  OrderId nextOrderId_;
+  std::vector<OrderId> live_;
+
+  Side RandomSide() {
+    return std::bernoulli_distribution{0.5}(random_) ? Side::Buy : Side::Sell;
+  }
+
+  // Passive prices sit behind the touch, geometrically fewer further out
+  Price PriceFor(Side side) {
+    const auto offset =
+        static_cast<Price>(std::geometric_distribution<int>{0.2}(random_));
+    return side == Side::Buy ? mid_ - 1 - offset : mid_ + 1 + offset;
+  }
+
+  Quantity RandomQuantity() {
+    return std::uniform_int_distribution<Quantity>{1, 100}(random_);
+  }
+
+  OrderCommand Add() {
+    static constexpr OrderType Types[] = {
+        OrderType::GoodTillCancel, OrderType::GoodForDay,
+        OrderType::FillAndKill, OrderType::FillOrKill, OrderType::Market};
+    std::discrete_distribution<int> type{60, 15, 15, 5, 5};
+
+    OrderCommand command;
+    command.type_ = CommandType::Add;
+    command.orderType_ = Types[type(random_)];
+    command.side_ = RandomSide();
+    command.quantity_ = RandomQuantity();
+    command.orderId_ = nextOrderId_++;
+    // Aggressive orders reach a tick or two through the mid
+    command.price_ =
+        command.orderType_ == OrderType::FillAndKill ||
+                command.orderType_ == OrderType::FillOrKill
+            ? (command.side_ == Side::Buy ? mid_ + 2 : mid_ - 2)
+            : PriceFor(command.side_);
+
+    if (command.orderType_ == OrderType::GoodTillCancel ||
+        command.orderType_ == OrderType::GoodForDay)
+      live_.push_back(command.orderId_);
+    return command;
+  }
+
+public:
+  FlowGenerator(std::uint64_t seed, std::size_t thread)
+      : random_{seed * 1'000'003 + thread},
+        // Every thread gets its own id range
+        nextOrderId_{(static_cast<OrderId>(thread) << 40) + 1} {}
+
+  OrderCommand Next() {
+    if (std::bernoulli_distribution{0.05}(random_))
+      mid_ += std::bernoulli_distribution{0.5}(random_) ? 1 : -1;
+
+    const auto action = std::uniform_int_distribution<int>{0, 99}(random_);
+    if (live_.empty() || action < 60)
+      return Add();
+
+    const auto pick =
+        std::uniform_int_distribution<std::size_t>{0, live_.size() - 1}(random_);
+    OrderCommand command;
+    command.orderId_ = live_[pick];
+
+    if (action < 85) {
+      command.type_ = CommandType::Cancel;
+      live_[pick] = live_.back();
+      live_.pop_back();
+    } else {
+      command.type_ = CommandType::Modify;
+      command.side_ = RandomSide();
+      command.price_ = PriceFor(command.side_);
+      command.quantity_ = RandomQuantity();
+    }
+    return command;
+  }
+};
+
+struct RunResult {
+  std::size_t threads_{};
+  std::size_t ops_{};
+  double seconds_{};
+  std::uint64_t trades_{};
+  InstrumentationSnapshot stats_{};
+};
+
+std::vector<std::vector<OrderCommand>> GenerateFlow(const Options &options,
+                                                    std::size_t threads) {
+  std::vector<std::vector<OrderCommand>> streams(threads);
+  for (std::size_t thread = 0; thread < threads; ++thread) {
+    FlowGenerator generator{options.seed_, thread};
+    streams[thread].reserve(options.ops_);
+    for (std::size_t op = 0; op < options.ops_; ++op)
+      streams[thread].push_back(generator.Next());
+  }
+  return streams;
+}
+
+// Every producer calls straight into one Locked book
+RunResult RunLocked(const std::vector<std::vector<OrderCommand>> &streams) {
+  Orderbook orderbook;
+  std::atomic<std::uint64_t> trades{};
+  std::atomic<bool> go{false};
+
+  std::vector<std::thread> producers;
+  for (const auto &stream : streams) {
+    producers.emplace_back([&orderbook, &trades, &go, &stream] {
+      std::uint64_t mine{};
+      auto onTrade = [&mine](const Trade &) { ++mine; };
+      while (!go.load(std::memory_order_acquire)) {
+      }
+      for (const auto &command : stream)
+        ApplyCommand(orderbook, command, onTrade);
+      trades.fetch_add(mine, std::memory_order_relaxed);
+    });
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto &producer : producers)
+    producer.join();
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  return RunResult{streams.size(), streams.size() * streams.front().size(),
+                   std::chrono::duration<double>(elapsed).count(),
+                   trades.load(), orderbook.GetInstrumentation()};
+}
+
+// Every producer pushes into its own ring of one Sequencer; the clock stops
+// once the last command's Completed report is back
+RunResult RunSequenced(const std::vector<std::vector<OrderCommand>> &streams) {
+  Sequencer sequencer{streams.size(), 1 << 16};
+  const auto total = streams.size() * streams.front().size();
+  std::atomic<bool> go{false};
+
+  std::vector<std::thread> producers;
+  for (std::size_t producer = 0; producer < streams.size(); ++producer) {
+    producers.emplace_back([&sequencer, &go, &stream = streams[producer],
+                            producer] {
+      while (!go.load(std::memory_order_acquire)) {
+      }
+      for (const auto &command : stream) {
+        while (!sequencer.TrySubmit(producer, command))
+          std::this_thread::yield();
+      }
+    });
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+
+  std::uint64_t trades{};
+  std::size_t completed{};
+  ExecutionReport report;
+  while (completed < total) {
+    if (!sequencer.TryPoll(report))
+      continue;
+    if (report.type_ == ReportType::Trade)
+      ++trades;
+    else
+      ++completed;
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  for (auto &producer : producers)
+    producer.join();
+  return RunResult{streams.size(), total,
+                   std::chrono::duration<double>(elapsed).count(), trades,
+                   {}};
+}
+
+std::vector<std::size_t> ParseList(const char *text) {
+  std::vector<std::size_t> values;
+  std::stringstream stream{text};
+  std::string value;
+  while (std::getline(stream, value, ','))
+    values.push_back(std::max<std::size_t>(std::stoul(value), 1));
+  return values;
+}
+
+bool ParseOptions(int argc, char **argv, Options &options) {
+  for (int index = 1; index < argc; ++index) {
+    const std::string_view arg{argv[index]};
+    const bool hasValue = index + 1 < argc;
+
+    if (arg == "--sequencer")
+      options.sequencer_ = true;
+    else if (arg == "--threads" && hasValue)
+      options.threads_ = ParseList(argv[++index]);
+    else if (arg == "--ops" && hasValue)
+      options.ops_ = std::max<std::size_t>(std::stoul(argv[++index]), 1);
+    else if (arg == "--seed" && hasValue)
+      options.seed_ = std::stoull(argv[++index]);
+    else
+      return false;
+  }
+  return !options.threads_.empty();
+}
+
+void PrintRow(const RunResult &result, double baseline) {
+  const auto opsPerSecond = static_cast<double>(result.ops_) / result.seconds_;
+  const auto &lockWait = result.stats_.Get(Stage::LockWait);
+  const auto contended = result.stats_.Get(Counter::LockContended);
+
+  std::cout << std::setw(8) << result.threads_ << std::setw(12) << result.ops_
+            << std::setw(14) << std::fixed << std::setprecision(0)
+            << opsPerSecond << std::setw(10) << std::setprecision(2)
+            << opsPerSecond / baseline << std::setw(12) << result.trades_;
+
+  if (lockWait.count_ != 0)
+    std::cout << std::setw(12) << std::setprecision(1)
+              << 100.0 * static_cast<double>(contended) /
+                     static_cast<double>(lockWait.count_)
+              << std::setw(14) << std::setprecision(0) << lockWait.Mean()
+              << std::setw(14) << lockWait.Percentile(0.99);
+  std::cout << '\n';
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  try {
+    if (!ParseOptions(argc, argv, options)) {
+      std::cerr << "usage: " << argv[0]
+                << " [--threads 1,2,4,8] [--ops N] [--seed N] [--sequencer]\n";
+      return 1;
+    }
+  } catch (const std::exception &) {
+    std::cerr << "bad numeric argument\n";
+    return 1;
+  }
+
+  std::cout << (options.sequencer_ ? "Sequencer" : "Locked Orderbook") << ", "
+            << options.ops_ << " ops per producer, seed " << options.seed_
+            << "\n\n"
+            << std::setw(8) << "threads" << std::setw(12) << "ops"
+            << std::setw(14) << "ops/s" << std::setw(10) << "scaling"
+            << std::setw(12) << "trades";
+#ifdef ORDERBOOK_ENABLE_INSTRUMENTATION
+  if (!options.sequencer_)
+    std::cout << std::setw(12) << "contended%" << std::setw(14)
+              << "wait_mean" << std::setw(14) << "wait_p99";
+#endif
+  std::cout << '\n';
+
+  double baseline{};
+  for (const auto threads : options.threads_) {
+    const auto streams = GenerateFlow(options, threads);
+    const auto result =
+        options.sequencer_ ? RunSequenced(streams) : RunLocked(streams);
+
+    if (baseline == 0)
+      baseline = static_cast<double>(result.ops_) / result.seconds_;
+    PrintRow(result, baseline);
+  }
+
+#ifndef ORDERBOOK_ENABLE_INSTRUMENTATION
+  if (!options.sequencer_)
+    std::cout << "\n(lock wait needs -DORDERBOOK_ENABLE_INSTRUMENTATION=ON)\n";
+#else
+  std::cout << "\n(lock wait in ReadTsc() ticks)\n";
+#endif
+  return 0;
+}
@@ -0,0 +1,48 @@
+#include "../JournalReplay.hpp"
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+
+// Replays a journal written through OrderbookConfig::journal_ into a fresh
+// book and reports how long it took.
+//
+//   orderbook_replay <journal>
+//
+// The book is single-writer, so nothing is locked and the only work is
+// matching itself. Trades are counted rather than printed.
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    std::cerr << "usage: " << argv[0] << " <journal>\n";
+    return 1;
+  }
+
+  try {
+    const JournalReader journal{argv[1]};
+    const auto records = journal.Records();
+
+    OrderbookConfig config;
+    config.threadingMode_ = ThreadingMode::SingleWriter;
+    Orderbook orderbook{config};
+
+    std::uint64_t trades{};
+    const auto start = std::chrono::steady_clock::now();
+    ReplayJournal(orderbook, records, [&trades](const Trade &) { ++trades; });
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    const auto seconds = std::chrono::duration<double>(elapsed).count();
+    std::cout << "records:       " << records.size() << '\n'
+              << "trades:        " << trades << '\n'
+              << "resting:       " << orderbook.Size() << '\n'
+              << "elapsed (s):   " << seconds << '\n'
+              << "records/s:     "
+              << (seconds > 0 ? static_cast<double>(records.size()) / seconds
+                              : 0)
+              << '\n';
+  } catch (const std::exception &error) {
+    std::cerr << error.what() << '\n';
+    return 1;
+  }
+
+  return 0;
+}